@@ -0,0 +1,83 @@
+#include "ofMain.h"
+#include "ofAppNoWindow.h"
+
+#include "ofxISF.h"
+
+// compares the lexer and the regex lookup macro processor of
+// ofxISF::CodeGenerator on synthetic shaders, no GL context needed
+
+class ofApp : public ofBaseApp
+{
+public:
+	
+	void setup()
+	{
+		ofxISF::Uniforms uniforms;
+		
+		const char *images[] = { "inputImage", "maskImage", "accum", "lut" };
+		for (int i = 0; i < 4; i++)
+		{
+			uniforms.addUniform(images[i], ofxISF::Uniform::Ref(new ofxISF::ImageUniform(images[i])));
+		}
+		
+		int counts[] = { 10, 100, 500, 2000 };
+		for (int i = 0; i < 4; i++)
+		{
+			string source = make_source(counts[i], images);
+			
+			ofxISF::CodeGenerator lexer(uniforms);
+			lexer.setMacroProcessor(ofxISF::CodeGenerator::MACRO_LEXER);
+			
+			ofxISF::CodeGenerator regex(uniforms);
+			regex.setMacroProcessor(ofxISF::CodeGenerator::MACRO_REGEX);
+			
+			float t0 = measure(lexer, source);
+			float t1 = measure(regex, source);
+			
+			bool same = lexer.getFragmentShader() == regex.getFragmentShader();
+			
+			cout << counts[i] << " lookups, " << source.size() << " bytes: "
+				<< "lexer " << t0 << " ms, regex " << t1 << " ms"
+				<< (same ? "" : " (OUTPUT DIFFERS)") << endl;
+		}
+		
+		ofExit();
+	}
+	
+	string make_source(int num_lookups, const char **images)
+	{
+		string s = "void main()\n{\n\tvec4 c = vec4(0.0);\n";
+		for (int i = 0; i < num_lookups; i++)
+		{
+			const char *image = images[i % 4];
+			switch (i % 4)
+			{
+				case 0: s += "\tc += IMG_THIS_PIXEL(" + string(image) + ");\n"; break;
+				case 1: s += "\tc += IMG_THIS_NORM_PIXEL(" + string(image) + ");\n"; break;
+				case 2: s += "\tc += IMG_PIXEL(" + string(image) + ", gl_FragCoord.xy + vec2(" + ofToString(i) + ".0, 0.0));\n"; break;
+				case 3: s += "\tc += IMG_NORM_PIXEL(" + string(image) + ", vv_FragNormCoord * 0.5);\n"; break;
+			}
+		}
+		s += "\tgl_FragColor = c / " + ofToString(num_lookups) + ".0;\n}\n";
+		return s;
+	}
+	
+	float measure(ofxISF::CodeGenerator &generator, const string &source)
+	{
+		const int num_iterations = 20;
+		
+		unsigned long long t = ofGetElapsedTimeMicros();
+		for (int i = 0; i < num_iterations; i++)
+			generator.generate(source);
+		
+		return (ofGetElapsedTimeMicros() - t) / 1000.0 / num_iterations;
+	}
+};
+
+int main(int argc, const char** argv)
+{
+	ofAppNoWindow window;
+	ofSetupOpenGL(&window, 0, 0, OF_WINDOW);
+	ofRunApp(new ofApp);
+	return 0;
+}
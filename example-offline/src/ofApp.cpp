@@ -0,0 +1,153 @@
+#include "ofMain.h"
+
+#include "ofxISF.h"
+#include "ofxISF/Headless.h"
+
+// renders ISF shaders to an image sequence without a display, TIME
+// advances by 1 / fps per frame no matter how long a frame takes
+//
+//   example-offline [options] shader.fs [shader.fs ...]
+//
+//   -o pattern     output files, printf style (frames/%05d.png)
+//   -w width       (1280)
+//   -h height      (720)
+//   -r fps         (30)
+//   -n frames      (300)
+//   -t seconds     TIME of the first frame (0)
+//   -i image       fed to the first shader's image input
+//
+// a single shader renders on its own, more than one renders them as a
+// Chain
+//
+//   example-offline -n 60 -o zoom/%05d.png ../example-chain/bin/data/ZoomBlur.fs
+
+struct Options
+{
+	string output;
+	int width, height;
+	float frame_rate;
+	int num_frames;
+	float start_time;
+	string image;
+	vector<string> shaders;
+
+	Options() : output("frames/%05d.png"), width(1280), height(720), frame_rate(30), num_frames(300), start_time(0) {}
+};
+
+class ofApp : public ofBaseApp
+{
+public:
+
+	Options options;
+
+	ofxISF::Shader shader;
+	ofxISF::Chain chain;
+	ofxISF::FixedStepClock *clock;
+	bool use_chain;
+
+	ofImage image;
+	ofPixels pixels;
+
+	ofApp(const Options& options) : options(options), clock(NULL), use_chain(false) {}
+
+	void setup()
+	{
+		// owned by the shader or the chain
+		clock = new ofxISF::FixedStepClock(options.frame_rate, options.start_time);
+		use_chain = options.shaders.size() > 1;
+
+		if (use_chain)
+		{
+			chain.setup(options.width, options.height);
+			chain.setClock(ofxISF::Clock::Ref(clock));
+		}
+		else
+		{
+			shader.setup(options.width, options.height);
+			shader.setClock(ofxISF::Clock::Ref(clock));
+		}
+
+		for (int i = 0; i < options.shaders.size(); i++)
+		{
+			bool loaded = use_chain ? chain.load(options.shaders[i]) : shader.load(options.shaders[i]);
+			if (!loaded)
+			{
+				ofLogError() << "can't load " << options.shaders[i];
+				ofExit(1);
+			}
+		}
+
+		if (!options.image.empty())
+		{
+			if (!image.loadImage(options.image))
+			{
+				ofLogError() << "can't load " << options.image;
+				ofExit(1);
+			}
+			if (use_chain) chain.setImage(image);
+			else shader.setImage(image);
+		}
+
+		ofDirectory::createDirectory(ofFilePath::getEnclosingDirectory(options.output, false), false, true);
+
+		unsigned long long start = ofGetElapsedTimeMicros();
+
+		for (int i = 0; i < options.num_frames; i++)
+		{
+			clock->setFrame(i);
+			if (use_chain) chain.update();
+			else shader.update();
+
+			ofTexture &result = use_chain ? chain.getTextureReference() : shader.getTextureReference();
+			result.readToPixels(pixels);
+
+			char path[1024];
+			snprintf(path, sizeof(path), options.output.c_str(), i);
+			ofSaveImage(pixels, path);
+		}
+
+		float seconds = (ofGetElapsedTimeMicros() - start) / 1000000.0;
+		cout << options.num_frames << " frames in " << seconds << " s, " << options.num_frames / seconds << " fps" << endl;
+
+		ofExit(0);
+	}
+};
+
+static bool parse_options(int argc, const char** argv, Options& options)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "-o" && has_value) options.output = argv[++i];
+		else if (arg == "-w" && has_value) options.width = ofToInt(argv[++i]);
+		else if (arg == "-h" && has_value) options.height = ofToInt(argv[++i]);
+		else if (arg == "-r" && has_value) options.frame_rate = ofToFloat(argv[++i]);
+		else if (arg == "-n" && has_value) options.num_frames = ofToInt(argv[++i]);
+		else if (arg == "-t" && has_value) options.start_time = ofToFloat(argv[++i]);
+		else if (arg == "-i" && has_value) options.image = ofFilePath::getAbsolutePath(argv[++i], false);
+		else if (!arg.empty() && arg[0] == '-') return false;
+		else options.shaders.push_back(ofFilePath::getAbsolutePath(arg, false));
+	}
+
+	// relative to the working directory, not to bin/data
+	options.output = ofFilePath::getAbsolutePath(options.output, false);
+
+	return !options.shaders.empty() && options.width > 0 && options.height > 0 && options.frame_rate > 0;
+}
+
+int main(int argc, const char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options))
+	{
+		cerr << "usage: " << argv[0] << " [-o frames/%05d.png] [-w 1280] [-h 720] [-r 30] [-n 300] [-t 0] [-i image] shader.fs [shader.fs ...]" << endl;
+		return 1;
+	}
+
+	ofxISF::HeadlessWindow window;
+	ofSetupOpenGL(&window, options.width, options.height, OF_WINDOW);
+	ofRunApp(new ofApp(options));
+	return 0;
+}
@@ -1,7 +1,21 @@
 #pragma once
 
 #include "ofxISF/Constants.h"
+#include "ofxISF/Trace.h"
+#include "ofxISF/Program.h"
 #include "ofxISF/Uniforms.h"
+#include "ofxISF/Expression.h"
+#include "ofxISF/Mailbox.h"
+#include "ofxISF/Automation.h"
 #include "ofxISF/CodeGenerater.h"
+#include "ofxISF/Bundle.h"
+#include "ofxISF/RenderTargetPool.h"
+#include "ofxISF/GpuTimer.h"
+#include "ofxISF/Clock.h"
+#include "ofxISF/AsyncReadback.h"
+#include "ofxISF/StreamingTexture.h"
+#include "ofxISF/Catalog.h"
 #include "ofxISF/Shader.h"
 #include "ofxISF/Chain.h"
+#include "ofxISF/Graph.h"
+#include "ofxISF/Library.h"
@@ -0,0 +1,270 @@
+#pragma once
+
+#include "Constants.h"
+#include "Trace.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Reads textures back to the CPU without stalling.
+//
+// read() copies into one of depth pixel buffer objects and drops a fence,
+// the GPU finishes the copy in the background. A frame becomes available
+// once its fence signaled, usually depth - 1 frames later, and is handed
+// out as an ofPixels view of the mapped buffer, nothing is copied on the
+// CPU side. Frames come out in order. When all buffers are still in
+// flight or held, read() drops the frame instead of waiting.
+//
+// Either poll with getFrame()/releaseFrame() or call update() every frame
+// and listen to frameEvent. GL thread only, needs PBOs, sync objects, fbos
+// and glMapBufferRange (GL 3.2 or ARB_pixel_buffer_object + ARB_sync +
+// ARB_framebuffer_object + ARB_map_buffer_range).
+//
+// Safe on pooled Shader results: the copy is queued before the target is
+// handed out again.
+//
+// Pixels are always read as 8 bit per channel (GL_RGBA, GL_BGRA, GL_RGB,
+// GL_BGR, GL_RED or GL_LUMINANCE), float targets such as GL_RGBA32F are
+// clamped to 0-1 and quantized.
+
+class AsyncReadback
+{
+public:
+
+	struct Frame
+	{
+		// valid until releaseFrame(), or the end of the event
+		ofPixels pixels;
+
+		// counts read() calls, including dropped ones
+		unsigned long long index;
+	};
+
+	// fired by update() for every frame that became available
+	ofEvent<Frame> frameEvent;
+
+	AsyncReadback(size_t depth = 3, int glFormat = GL_RGBA)
+		:slots(max<size_t>(depth, 1))
+		,format(glFormat)
+		,head(0)
+		,num_queued(0)
+		,mapped(-1)
+		,num_read(0)
+		,num_dropped(0)
+		,framebuffer(0)
+	{
+		if (get_num_channels(format) == 0)
+		{
+			ofLogError("ofxISF::AsyncReadback") << "unsupported format: 0x" << hex << glFormat;
+			format = 0;
+		}
+	}
+
+	~AsyncReadback()
+	{
+		if (mapped >= 0) releaseFrame();
+
+		for (int i = 0; i < slots.size(); i++)
+		{
+			Slot &s = slots[i];
+			if (s.fence) glDeleteSync(s.fence);
+			if (s.buffer) glDeleteBuffers(1, &s.buffer);
+		}
+
+		if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+	}
+
+	static bool isSupported()
+	{
+		return GLEW_VERSION_3_2
+			|| (GLEW_ARB_pixel_buffer_object && GLEW_ARB_sync && GLEW_ARB_framebuffer_object && GLEW_ARB_map_buffer_range);
+	}
+
+	// returns false if the frame was dropped
+	bool read(ofTexture& tex)
+	{
+		OFX_ISF_TRACE_SCOPE("AsyncReadback::read");
+
+		unsigned long long index = num_read++;
+
+		if (format == 0 || !isSupported() || !tex.isAllocated()) return false;
+
+		Slot &s = slots[head];
+		if (num_queued == slots.size() || s.state != FREE)
+		{
+			num_dropped++;
+			return false;
+		}
+
+		const ofTextureData &data = tex.getTextureData();
+
+		s.width = data.width;
+		s.height = data.height;
+		s.channels = get_num_channels(format);
+		s.index = index;
+
+		size_t size = s.width * s.height * s.channels;
+
+		if (s.buffer == 0) glGenBuffers(1, &s.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+		if (s.size != size)
+		{
+			glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+			s.size = size;
+		}
+
+		GLint previous_framebuffer = 0;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_framebuffer);
+
+		if (framebuffer == 0) glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, data.textureTarget, data.textureID, 0);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+		GLint previous_alignment = 4;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &previous_alignment);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+		// into the bound buffer, returns right away
+		glReadPixels(0, 0, s.width, s.height, format, GL_UNSIGNED_BYTE, 0);
+
+		glPixelStorei(GL_PACK_ALIGNMENT, previous_alignment);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, previous_framebuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		s.state = PENDING;
+
+		// getFrame() polls without flushing, make sure the fence gets to the GPU
+		glFlush();
+
+		head = (head + 1) % slots.size();
+		num_queued++;
+
+		return true;
+	}
+
+	inline bool read(ofFbo& fbo) { return read(fbo.getTextureReference()); }
+
+	// the oldest queued frame if the GPU is done with it, never waits.
+	// hold at most one frame at a time.
+	bool getFrame(Frame& frame)
+	{
+		if (mapped >= 0 || num_queued == 0) return false;
+
+		int tail = (head + slots.size() - num_queued) % slots.size();
+		Slot &s = slots[tail];
+
+		GLenum status = glClientWaitSync(s.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+
+		glDeleteSync(s.fence);
+		s.fence = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+		unsigned char *ptr = (unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, s.size, GL_MAP_READ_BIT);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		if (ptr == NULL)
+		{
+			ofLogError("ofxISF::AsyncReadback") << "map failed";
+			s.state = FREE;
+			num_queued--;
+			return false;
+		}
+
+		s.state = MAPPED;
+		mapped = tail;
+
+		frame.pixels.setFromExternalPixels(ptr, s.width, s.height, s.channels);
+		frame.index = s.index;
+
+		return true;
+	}
+
+	// gives the buffer of the frame from getFrame() back to the ring
+	void releaseFrame()
+	{
+		if (mapped < 0) return;
+
+		Slot &s = slots[mapped];
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		s.state = FREE;
+		mapped = -1;
+		num_queued--;
+	}
+
+	// notifies frameEvent for every available frame
+	void update()
+	{
+		Frame frame;
+		while (getFrame(frame))
+		{
+			ofNotifyEvent(frameEvent, frame, this);
+			releaseFrame();
+		}
+	}
+
+	size_t getDepth() const { return slots.size(); }
+	size_t getNumQueued() const { return num_queued; }
+	unsigned long long getNumDropped() const { return num_dropped; }
+
+protected:
+
+	enum State
+	{
+		FREE,
+		PENDING,
+		MAPPED
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		size_t size;
+		GLsync fence;
+		State state;
+
+		int width, height, channels;
+		unsigned long long index;
+
+		Slot() : buffer(0), size(0), fence(0), state(FREE), width(0), height(0), channels(0), index(0) {}
+	};
+
+	vector<Slot> slots;
+	int format;
+
+	// next slot to write, slots before it (wrapping) are queued
+	int head;
+	size_t num_queued;
+	int mapped;
+
+	unsigned long long num_read;
+	unsigned long long num_dropped;
+
+	GLuint framebuffer;
+
+	static int get_num_channels(int format)
+	{
+		switch (format)
+		{
+			case GL_RGBA:
+			case GL_BGRA: return 4;
+			case GL_RGB:
+			case GL_BGR: return 3;
+			case GL_LUMINANCE:
+			case GL_RED: return 1;
+			default: return 0;
+		}
+	}
+
+private:
+
+	AsyncReadback(const AsyncReadback&);
+	AsyncReadback& operator=(const AsyncReadback&);
+};
+
+OFX_ISF_END_NAMESPACE
@@ -0,0 +1,451 @@
+#pragma once
+
+#include "Constants.h"
+#include "Uniforms.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Keyframe and LFO curves for float, color and point2D uniforms.
+//
+// Every animated float component is a channel. Curve parameters are kept
+// in structure-of-arrays form and evaluated in straight loops without
+// branches or libm calls, so the compiler can vectorize them. The results
+// are clamped to the uniform range and written through Uniform_::set().
+// Each Uniforms set owns one, see Uniforms::getAutomation().
+
+class Automation
+{
+public:
+
+	enum Waveform
+	{
+		SINE,
+		TRIANGLE,
+		SAW,
+		SQUARE,
+		NUM_WAVEFORMS
+	};
+
+	struct Keyframe
+	{
+		float time;
+		float value;
+
+		Keyframe() : time(0), value(0) {}
+		Keyframe(float time, float value) : time(time), value(value) {}
+	};
+
+	// offset + amplitude * wave(time * frequency + phase), wave in [-1, 1]
+	bool addLFO(const UniformHandle<float>& handle, Waveform waveform, float frequency, float amplitude, float offset, float phase = 0)
+	{
+		return add_lfo(handle.ref, FLOAT, 0, waveform, frequency, amplitude, offset, phase);
+	}
+
+	bool addLFO(const UniformHandle<ofFloatColor>& handle, int component, Waveform waveform, float frequency, float amplitude, float offset, float phase = 0)
+	{
+		return add_lfo(handle.ref, COLOR, component, waveform, frequency, amplitude, offset, phase);
+	}
+
+	bool addLFO(const UniformHandle<ofVec2f>& handle, int component, Waveform waveform, float frequency, float amplitude, float offset, float phase = 0)
+	{
+		return add_lfo(handle.ref, POINT2D, component, waveform, frequency, amplitude, offset, phase);
+	}
+
+	// linear interpolation between keyframes sorted by time, holds the
+	// end values outside of the range unless loop is set
+	bool addKeyframes(const UniformHandle<float>& handle, const vector<Keyframe>& keys, bool loop = false)
+	{
+		return add_keyframes(handle.ref, FLOAT, 0, keys, loop);
+	}
+
+	bool addKeyframes(const UniformHandle<ofFloatColor>& handle, int component, const vector<Keyframe>& keys, bool loop = false)
+	{
+		return add_keyframes(handle.ref, COLOR, component, keys, loop);
+	}
+
+	bool addKeyframes(const UniformHandle<ofVec2f>& handle, int component, const vector<Keyframe>& keys, bool loop = false)
+	{
+		return add_keyframes(handle.ref, POINT2D, component, keys, loop);
+	}
+
+	void clear()
+	{
+		for (int i = 0; i < NUM_WAVEFORMS; i++)
+			lfo_banks[i] = LFOBank();
+
+		key_channel.clear();
+		key_begin.clear();
+		key_end.clear();
+		key_cursor.clear();
+		key_loop.clear();
+		key_time.clear();
+		key_value.clear();
+
+		channel_min.clear();
+		channel_max.clear();
+		channel_value.clear();
+
+		targets.clear();
+		target_map.clear();
+	}
+
+	bool empty() const { return channel_value.empty(); }
+	size_t getNumChannels() const { return channel_value.size(); }
+
+	void update(float time)
+	{
+		if (channel_value.empty()) return;
+
+		for (int i = 0; i < NUM_WAVEFORMS; i++)
+			evaluate_lfo((Waveform)i, time);
+
+		evaluate_keyframes(time);
+
+		// clamp to the uniform ranges
+		const size_t n = channel_value.size();
+		float *value = &channel_value[0];
+		const float *lo = &channel_min[0];
+		const float *hi = &channel_max[0];
+
+		for (size_t i = 0; i < n; i++)
+		{
+			float v = value[i];
+			v = v < lo[i] ? lo[i] : v;
+			v = v > hi[i] ? hi[i] : v;
+			value[i] = v;
+		}
+
+		for (int i = 0; i < targets.size(); i++)
+			write_target(targets[i]);
+	}
+
+protected:
+
+	enum TargetType
+	{
+		FLOAT,
+		COLOR,
+		POINT2D
+	};
+
+	struct Target
+	{
+		Uniform::Ref uniform;
+		TargetType type;
+		int channel[4];
+
+		Target() : type(FLOAT)
+		{
+			for (int i = 0; i < 4; i++) channel[i] = -1;
+		}
+	};
+
+	struct LFOBank
+	{
+		vector<int> channel;
+		vector<float> frequency;
+		vector<float> phase;
+		vector<float> amplitude;
+		vector<float> offset;
+		vector<float> result;
+	};
+
+	LFOBank lfo_banks[NUM_WAVEFORMS];
+
+	// keyframe curves, keys of all channels in one flat array
+	vector<int> key_channel;
+	vector<size_t> key_begin, key_end, key_cursor;
+	vector<bool> key_loop;
+	vector<float> key_time, key_value;
+
+	// per channel
+	vector<float> channel_min, channel_max;
+	vector<float> channel_value;
+
+	vector<Target> targets;
+	map<Uniform*, size_t> target_map;
+
+	//
+
+	int add_channel(const Uniform::Ref& uniform, TargetType type, int component)
+	{
+		if (!uniform) return -1;
+
+		int num_components = type == COLOR ? 4 : (type == POINT2D ? 2 : 1);
+		if (component < 0 || component >= num_components) return -1;
+
+		size_t target_index;
+		map<Uniform*, size_t>::iterator it = target_map.find(uniform.get());
+		if (it == target_map.end())
+		{
+			Target t;
+			t.uniform = uniform;
+			t.type = type;
+
+			target_index = targets.size();
+			targets.push_back(t);
+			target_map[uniform.get()] = target_index;
+		}
+		else
+		{
+			target_index = it->second;
+		}
+
+		Target &t = targets[target_index];
+		if (t.channel[component] >= 0)
+		{
+			ofLogError("ofxISF::Automation") << "already automated: " << uniform->getName() << "[" << component << "]";
+			return -1;
+		}
+
+		int channel = channel_value.size();
+		t.channel[component] = channel;
+
+		float lo = -numeric_limits<float>::max();
+		float hi = numeric_limits<float>::max();
+		get_range(t, component, lo, hi);
+
+		channel_min.push_back(lo);
+		channel_max.push_back(hi);
+		channel_value.push_back(0);
+
+		return channel;
+	}
+
+	bool add_lfo(const Uniform::Ref& uniform, TargetType type, int component, Waveform waveform, float frequency, float amplitude, float offset, float phase)
+	{
+		int channel = add_channel(uniform, type, component);
+		if (channel < 0) return false;
+
+		LFOBank &bank = lfo_banks[waveform];
+		bank.channel.push_back(channel);
+		bank.frequency.push_back(frequency);
+		bank.phase.push_back(phase);
+		bank.amplitude.push_back(amplitude);
+		bank.offset.push_back(offset);
+		bank.result.push_back(0);
+
+		return true;
+	}
+
+	bool add_keyframes(const Uniform::Ref& uniform, TargetType type, int component, const vector<Keyframe>& keys, bool loop)
+	{
+		if (keys.empty()) return false;
+
+		int channel = add_channel(uniform, type, component);
+		if (channel < 0) return false;
+
+		key_channel.push_back(channel);
+		key_begin.push_back(key_time.size());
+		key_cursor.push_back(key_time.size());
+		key_loop.push_back(loop);
+
+		for (int i = 0; i < keys.size(); i++)
+		{
+			key_time.push_back(keys[i].time);
+			key_value.push_back(keys[i].value);
+		}
+
+		key_end.push_back(key_time.size());
+
+		return true;
+	}
+
+	static void get_range(const Target& t, int component, float& lo, float& hi)
+	{
+		if (t.type == FLOAT)
+		{
+			FloatUniform *o = static_cast<FloatUniform*>(t.uniform.get());
+			if (!o->has_range) return;
+			lo = o->min;
+			hi = o->max;
+		}
+		else if (t.type == COLOR)
+		{
+			ColorUniform *o = static_cast<ColorUniform*>(t.uniform.get());
+			if (!o->has_range) return;
+			lo = (&o->min.r)[component];
+			hi = (&o->max.r)[component];
+		}
+		else if (t.type == POINT2D)
+		{
+			Point2DUniform *o = static_cast<Point2DUniform*>(t.uniform.get());
+			if (!o->has_range) return;
+			lo = o->min[component];
+			hi = o->max[component];
+		}
+	}
+
+	//
+
+	void evaluate_lfo(Waveform waveform, float time)
+	{
+		LFOBank &bank = lfo_banks[waveform];
+
+		const size_t n = bank.channel.size();
+		if (n == 0) return;
+
+		const float *frequency = &bank.frequency[0];
+		const float *phase = &bank.phase[0];
+		const float *amplitude = &bank.amplitude[0];
+		const float *offset = &bank.offset[0];
+		float *result = &bank.result[0];
+
+		switch (waveform)
+		{
+			case SINE:
+				for (size_t i = 0; i < n; i++)
+					result[i] = offset[i] + amplitude[i] * fast_sin(frac(time * frequency[i] + phase[i]));
+				break;
+
+			case TRIANGLE:
+				for (size_t i = 0; i < n; i++)
+				{
+					float x = frac(time * frequency[i] + phase[i]);
+					float d = x - 0.5f;
+					d = d < 0 ? -d : d;
+					result[i] = offset[i] + amplitude[i] * (1.0f - 4.0f * d);
+				}
+				break;
+
+			case SAW:
+				for (size_t i = 0; i < n; i++)
+				{
+					float x = frac(time * frequency[i] + phase[i]);
+					result[i] = offset[i] + amplitude[i] * (2.0f * x - 1.0f);
+				}
+				break;
+
+			case SQUARE:
+				for (size_t i = 0; i < n; i++)
+				{
+					float x = frac(time * frequency[i] + phase[i]);
+					float s = 1.0f - 2.0f * (float)(x >= 0.5f);
+					result[i] = offset[i] + amplitude[i] * s;
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		// scatter into the channel array
+		const int *channel = &bank.channel[0];
+		float *value = &channel_value[0];
+		for (size_t i = 0; i < n; i++)
+			value[channel[i]] = result[i];
+	}
+
+	void evaluate_keyframes(float time)
+	{
+		const size_t n = key_channel.size();
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const size_t begin = key_begin[i];
+			const size_t end = key_end[i];
+
+			const float t0 = key_time[begin];
+			const float t1 = key_time[end - 1];
+
+			float t = time;
+			if (key_loop[i] && t1 > t0)
+			{
+				t = t0 + frac((t - t0) / (t1 - t0)) * (t1 - t0);
+			}
+
+			float v;
+			if (t <= t0)
+			{
+				v = key_value[begin];
+			}
+			else if (t >= t1)
+			{
+				v = key_value[end - 1];
+			}
+			else
+			{
+				// time is mostly monotonic, so the cursor moves by a few keys at most
+				size_t k = key_cursor[i];
+				if (k + 1 >= end || key_time[k] > t) k = begin;
+				while (k + 2 < end && key_time[k + 1] <= t) k++;
+				key_cursor[i] = k;
+
+				float a = key_time[k];
+				float b = key_time[k + 1];
+				float w = b > a ? (t - a) / (b - a) : 0;
+				v = key_value[k] + (key_value[k + 1] - key_value[k]) * w;
+			}
+
+			channel_value[key_channel[i]] = v;
+		}
+	}
+
+	void write_target(const Target& t)
+	{
+		const float *value = &channel_value[0];
+
+		if (t.type == FLOAT)
+		{
+			FloatUniform *o = static_cast<FloatUniform*>(t.uniform.get());
+			o->set(value[t.channel[0]]);
+		}
+		else if (t.type == COLOR)
+		{
+			ColorUniform *o = static_cast<ColorUniform*>(t.uniform.get());
+			ofFloatColor c = o->value;
+			for (int i = 0; i < 4; i++)
+				if (t.channel[i] >= 0) (&c.r)[i] = value[t.channel[i]];
+			o->set(c);
+		}
+		else if (t.type == POINT2D)
+		{
+			Point2DUniform *o = static_cast<Point2DUniform*>(t.uniform.get());
+			ofVec2f p = o->value;
+			for (int i = 0; i < 2; i++)
+				if (t.channel[i] >= 0) p[i] = value[t.channel[i]];
+			o->set(p);
+		}
+	}
+
+	//
+
+	static inline float frac(float x)
+	{
+		// truncation instead of floorf() keeps the loops free of libm calls
+		float f = x - (float)(int)x;
+		return f + (float)(f < 0);
+	}
+
+	// sin(2 * PI * x) for x in [0, 1), max error around 0.001
+	static inline float fast_sin(float x)
+	{
+		const float B = 4.0f / PI;
+		const float C = -4.0f / (PI * PI);
+		const float P = 0.225f;
+
+		float y = (x - 0.5f) * TWO_PI; // [-PI, PI)
+		float ay = y < 0 ? -y : y;
+		float s = B * y + C * y * ay;
+		float as = s < 0 ? -s : s;
+		s = P * (s * as - s) + s;
+
+		// shifted by half a period
+		return -s;
+	}
+};
+
+//
+
+inline Automation& Uniforms::getAutomation()
+{
+	if (!automation) automation = Ref_<Automation>(new Automation);
+	return *automation;
+}
+
+inline void Uniforms::updateAutomation(float time)
+{
+	if (automation) automation->update(time);
+}
+
+OFX_ISF_END_NAMESPACE
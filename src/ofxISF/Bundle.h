@@ -0,0 +1,596 @@
+#pragma once
+
+#include "Poco/File.h"
+
+#include "Constants.h"
+#include "Trace.h"
+
+#include "jsonxx.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+class BinaryWriter
+{
+public:
+
+	BinaryWriter(ostream &os) : os(os) {}
+
+	void write(unsigned int v) { os.write((const char*)&v, sizeof(v)); }
+	void write(unsigned long long v) { os.write((const char*)&v, sizeof(v)); }
+	void write(long long v) { os.write((const char*)&v, sizeof(v)); }
+	void write(float v) { os.write((const char*)&v, sizeof(v)); }
+	void write(bool v) { write((unsigned int)(v ? 1 : 0)); }
+
+	void write(const string& v)
+	{
+		write((unsigned int)v.size());
+		os.write(v.data(), v.size());
+	}
+
+	void write(const vector<string>& v)
+	{
+		write((unsigned int)v.size());
+		for (int i = 0; i < v.size(); i++)
+			write(v[i]);
+	}
+
+	void write(const Input& v)
+	{
+		write(v.name);
+		write(v.type);
+		for (int n = 0; n < 4; n++) write(v.default_value[n]);
+		for (int n = 0; n < 4; n++) write(v.min_value[n]);
+		for (int n = 0; n < 4; n++) write(v.max_value[n]);
+		write(v.has_range);
+	}
+
+	bool good() const { return os.good(); }
+
+protected:
+
+	ostream &os;
+};
+
+class BinaryReader
+{
+public:
+
+	BinaryReader(istream &is) : is(is), end(-1)
+	{
+		// lengths are checked against the rest of the stream, so a
+		// truncated or corrupted file fails the read instead of allocating
+		streampos pos = is.tellg();
+		if (pos < 0) return;
+
+		is.seekg(0, ios::end);
+		end = is.tellg();
+		is.seekg(pos);
+	}
+
+	template <typename T>
+	bool read(T &v)
+	{
+		is.read((char*)&v, sizeof(v));
+		return is.good();
+	}
+
+	bool read(bool &v)
+	{
+		unsigned int i = 0;
+		if (!read(i)) return false;
+		v = i != 0;
+		return true;
+	}
+
+	// element count of a length prefixed sequence, each element taking at
+	// least min_element_size bytes
+	bool readCount(unsigned int &n, size_t min_element_size)
+	{
+		if (!read(n)) return false;
+		return fits(n, min_element_size);
+	}
+
+	bool read(string &v)
+	{
+		unsigned int size = 0;
+		if (!readCount(size, 1)) return false;
+		v.resize(size);
+		if (size == 0) return true;
+		is.read(&v[0], size);
+		return is.good();
+	}
+
+	bool read(vector<string> &v)
+	{
+		unsigned int size = 0;
+		if (!readCount(size, sizeof(unsigned int))) return false;
+		v.resize(size);
+		for (int i = 0; i < size; i++)
+			if (!read(v[i])) return false;
+		return true;
+	}
+
+	bool read(Input &v)
+	{
+		if (!read(v.name)) return false;
+		if (!read(v.type)) return false;
+		for (int n = 0; n < 4; n++) if (!read(v.default_value[n])) return false;
+		for (int n = 0; n < 4; n++) if (!read(v.min_value[n])) return false;
+		for (int n = 0; n < 4; n++) if (!read(v.max_value[n])) return false;
+		if (!read(v.has_range)) return false;
+		return true;
+	}
+
+protected:
+
+	istream &is;
+	streamoff end;
+
+	bool fits(unsigned int n, size_t min_element_size)
+	{
+		if (end < 0) return true;
+
+		streampos pos = is.tellg();
+		if (pos < 0) return false;
+
+		return (unsigned long long)n * min_element_size <= (unsigned long long)(end - (streamoff)pos);
+	}
+};
+
+//
+
+struct Bundle
+{
+	string path;
+	long long source_mtime;
+	unsigned long long source_size;
+	unsigned long long source_hash;
+
+	string name;
+	string description;
+	string credit;
+	vector<string> categories;
+
+	vector<Input> inputs;
+	vector<PresistentBuffer> presistent_buffers;
+	vector<Pass> passes;
+
+	string shader_directive;
+
+	// generated code, valid only for the sampler signature it was generated with
+	string sampler_signature;
+	string vert;
+	string frag;
+
+	Bundle() : source_mtime(0), source_size(0), source_hash(0) {}
+
+	bool parse(const string& data)
+	{
+		string header_directive;
+		if (!parse_directive(data, header_directive, shader_directive)) return false;
+		if (!parse_header(header_directive)) return false;
+
+		sampler_signature.clear();
+		vert.clear();
+		frag.clear();
+
+		return true;
+	}
+
+	static bool parse_directive(const string &data, string& header_directive, string& shader_directive)
+	{
+		OFX_ISF_TRACE_SCOPE("Bundle::parse_directive");
+
+		const string header_begin = "/*";
+		const string header_end = "*/";
+
+		string::size_type begin_pos = data.find_first_of(header_begin) + header_end.size();
+		string::size_type end_pos = data.find_first_of(header_end, begin_pos);
+		string::size_type count = end_pos - begin_pos;
+
+		if (begin_pos == end_pos
+			|| begin_pos == std::string::npos
+			|| end_pos == std::string::npos)
+		{
+			ofLogError("ofxISF") << "invalid format: missing header delective";
+			return false;
+		}
+
+		header_directive = data.substr(begin_pos, count);
+
+		string::size_type shader_begin = end_pos + header_end.size();
+		shader_directive = data.substr(shader_begin);
+
+		return true;
+	}
+
+	bool parse_header(const string& header_directive)
+	{
+		OFX_ISF_TRACE_SCOPE("Bundle::parse_header");
+
+		jsonxx::Object o;
+		if (!o.parse(header_directive))
+		{
+			ofLogError("ofxISF") << "invalid format: header is not valid json";
+			return false;
+		}
+
+		description = o.get<string>("DESCRIPTION", "");
+		credit = o.get<string>("CREDIT", "");
+
+		jsonxx::Array a;
+
+		{
+			categories.clear();
+			a = o.get<jsonxx::Array>("CATEGORIES", jsonxx::Array());
+			for (int i = 0; i < a.size(); i++)
+				if (a.has<string>(i))
+					categories.push_back(a.get<string>(i));
+		}
+
+		{
+			inputs.clear();
+
+			a = o.get<jsonxx::Array>("INPUTS", jsonxx::Array());
+			for (int i = 0; i < a.size(); i++)
+			{
+				jsonxx::Object o = a.get<jsonxx::Object>(i, jsonxx::Object());
+				inputs.push_back(parse_input(o));
+			}
+		}
+
+		{
+			presistent_buffers.clear();
+
+			if (o.has<jsonxx::Array>("PERSISTENT_BUFFERS"))
+			{
+				a = o.get<jsonxx::Array>("PERSISTENT_BUFFERS", jsonxx::Array());
+				for (int i = 0; i < a.size(); i++)
+				{
+					string name = a.get<string>(i);
+
+					PresistentBuffer buf;
+					buf.name = name;
+					presistent_buffers.push_back(buf);
+				}
+			}
+			else if (o.has<jsonxx::Object>("PERSISTENT_BUFFERS"))
+			{
+				jsonxx::Object obj = o.get<jsonxx::Object>("PERSISTENT_BUFFERS", jsonxx::Object());
+				const jsonxx::Object::container& kv_map = obj.kv_map();
+
+				jsonxx::Object::container::const_iterator it = kv_map.begin();
+				while (it != kv_map.end())
+				{
+					string name = it->first;
+					jsonxx::Object desc = obj.get<jsonxx::Object>(name, jsonxx::Object());
+
+					PresistentBuffer buf;
+					buf.name = name;
+					buf.width = parse_size_expression(desc, "WIDTH");
+					buf.height = parse_size_expression(desc, "HEIGHT");
+					buf.float_precision = desc.get<bool>("FLOAT", false);
+
+					presistent_buffers.push_back(buf);
+
+					it++;
+				}
+			}
+		}
+
+		{
+			passes.clear();
+
+			a = o.get<jsonxx::Array>("PASSES", jsonxx::Array());
+			for (int i = 0; i < a.size(); i++)
+			{
+				jsonxx::Object pass = a.get<jsonxx::Object>(i);
+
+				string target = pass.get<string>("TARGET", "");
+
+				Pass o;
+				o.target = target;
+				o.width = parse_size_expression(pass, "WIDTH");
+				o.height = parse_size_expression(pass, "HEIGHT");
+
+				passes.push_back(o);
+			}
+		}
+
+		return true;
+	}
+
+	// plain numbers are accepted too
+	static string parse_size_expression(const jsonxx::Object& obj, const string& key)
+	{
+		if (obj.has<jsonxx::Number>(key))
+			return ofToString(obj.get<jsonxx::Number>(key));
+		return obj.get<string>(key, "");
+	}
+
+	static Input parse_input(const jsonxx::Object& obj)
+	{
+		Input input;
+		input.name = obj.get<string>("NAME", "");
+		input.type = obj.get<string>("TYPE", "");
+
+		if (input.type == "bool")
+		{
+			input.default_value[0] = obj.get<bool>("DEFAULT", false);
+		}
+		else if (input.type == "float")
+		{
+			input.default_value[0] = obj.get<jsonxx::Number>("DEFAULT", 0);
+
+			if (obj.has<jsonxx::Number>("MIN") && obj.has<jsonxx::Number>("MAX"))
+			{
+				input.has_range = true;
+				input.min_value[0] = obj.get<jsonxx::Number>("MIN", std::numeric_limits<float>::min());
+				input.max_value[0] = obj.get<jsonxx::Number>("MAX", std::numeric_limits<float>::max());
+			}
+		}
+		else if (input.type == "color")
+		{
+			for (int i = 0; i < 4; i++)
+				input.default_value[i] = 1;
+			
+			jsonxx::Array a = obj.get<jsonxx::Array>("DEFAULT", jsonxx::Array());
+			if (a.size() == 4)
+			{
+				for (int i = 0; i < 4; i++)
+					input.default_value[i] = a.get<jsonxx::Number>(i, 0);
+			}
+		}
+		else if (input.type == "point2D")
+		{
+			jsonxx::Array a = obj.get<jsonxx::Array>("DEFAULT", jsonxx::Array());
+			if (a.size() == 2)
+			{
+				input.default_value[0] = a.get<jsonxx::Number>(0, 0);
+				input.default_value[1] = a.get<jsonxx::Number>(1, 0);
+			}
+		}
+
+		return input;
+	}
+
+#pragma mark -
+
+	enum {
+		MAGIC = 0x42465349, // "ISFB"
+		VERSION = 3
+	};
+
+	void write(ostream &os) const
+	{
+		BinaryWriter w(os);
+
+		w.write((unsigned int)MAGIC);
+		w.write((unsigned int)VERSION);
+
+		w.write(path);
+		w.write(source_mtime);
+		w.write(source_size);
+		w.write(source_hash);
+
+		w.write(name);
+		w.write(description);
+		w.write(credit);
+		w.write(categories);
+
+		w.write((unsigned int)inputs.size());
+		for (int i = 0; i < inputs.size(); i++)
+			w.write(inputs[i]);
+
+		w.write((unsigned int)presistent_buffers.size());
+		for (int i = 0; i < presistent_buffers.size(); i++)
+		{
+			const PresistentBuffer &o = presistent_buffers[i];
+			w.write(o.name);
+			w.write(o.width);
+			w.write(o.height);
+			w.write(o.float_precision);
+		}
+
+		w.write((unsigned int)passes.size());
+		for (int i = 0; i < passes.size(); i++)
+		{
+			const Pass &o = passes[i];
+			w.write(o.target);
+			w.write(o.width);
+			w.write(o.height);
+		}
+
+		w.write(shader_directive);
+		w.write(sampler_signature);
+		w.write(vert);
+		w.write(frag);
+	}
+
+	bool read(istream &is)
+	{
+		BinaryReader r(is);
+
+		unsigned int magic = 0, version = 0;
+		if (!r.read(magic) || magic != MAGIC) return false;
+		if (!r.read(version) || version != VERSION) return false;
+
+		if (!r.read(path)) return false;
+		if (!r.read(source_mtime)) return false;
+		if (!r.read(source_size)) return false;
+		if (!r.read(source_hash)) return false;
+
+		if (!r.read(name)) return false;
+		if (!r.read(description)) return false;
+		if (!r.read(credit)) return false;
+		if (!r.read(categories)) return false;
+
+		unsigned int num = 0;
+
+		if (!r.readCount(num, sizeof(unsigned int))) return false;
+		inputs.resize(num);
+		for (int i = 0; i < inputs.size(); i++)
+			if (!r.read(inputs[i])) return false;
+
+		if (!r.readCount(num, sizeof(unsigned int))) return false;
+		presistent_buffers.resize(num);
+		for (int i = 0; i < presistent_buffers.size(); i++)
+		{
+			PresistentBuffer &o = presistent_buffers[i];
+			if (!r.read(o.name)) return false;
+			if (!r.read(o.width)) return false;
+			if (!r.read(o.height)) return false;
+			if (!r.read(o.float_precision)) return false;
+		}
+
+		if (!r.readCount(num, sizeof(unsigned int))) return false;
+		passes.resize(num);
+		for (int i = 0; i < passes.size(); i++)
+		{
+			Pass &o = passes[i];
+			if (!r.read(o.target)) return false;
+			if (!r.read(o.width)) return false;
+			if (!r.read(o.height)) return false;
+		}
+
+		if (!r.read(shader_directive)) return false;
+		if (!r.read(sampler_signature)) return false;
+		if (!r.read(vert)) return false;
+		if (!r.read(frag)) return false;
+
+		return true;
+	}
+};
+
+//
+
+class BundleCache
+{
+public:
+
+	// empty path disables the cache (default)
+	static void setDirectory(const string& path)
+	{
+		getDirectoryRef() = path;
+		if (!path.empty()) ofDirectory::createDirectory(path, true, true);
+	}
+
+	static const string& getDirectory() { return getDirectoryRef(); }
+
+	static bool isEnabled() { return !getDirectoryRef().empty(); }
+
+	static bool load(const string& path, Bundle& bundle)
+	{
+		OFX_ISF_TRACE_SCOPE("BundleCache::load");
+
+		if (!ofFile::doesFileExist(path))
+		{
+			ofLogError("ofxISF") << "no such file";
+			return false;
+		}
+
+		string abs_path = ofToDataPath(path, true);
+
+		Poco::File file(abs_path);
+		long long mtime = file.getLastModified().epochMicroseconds();
+		unsigned long long size = file.getSize();
+
+		Bundle cached;
+		bool has_cache = isEnabled() && read(abs_path, cached) && cached.path == abs_path;
+
+		if (has_cache
+			&& cached.source_mtime == mtime
+			&& cached.source_size == size)
+		{
+			ofLogVerbose("ofxISF::BundleCache") << "hit: " << path;
+			bundle = cached;
+			return true;
+		}
+
+		string data = ofBufferFromFile(abs_path).getText();
+		unsigned long long hash = hash_string(data);
+
+		if (has_cache && cached.source_hash == hash)
+		{
+			// touched but not modified
+			ofLogVerbose("ofxISF::BundleCache") << "hit: " << path;
+			bundle = cached;
+			bundle.source_mtime = mtime;
+			bundle.source_size = size;
+			store(bundle);
+			return true;
+		}
+
+		ofLogVerbose("ofxISF::BundleCache") << "miss: " << path;
+
+		bundle = Bundle();
+		if (!bundle.parse(data)) return false;
+
+		bundle.path = abs_path;
+		bundle.name = ofFilePath::getBaseName(path);
+		bundle.source_mtime = mtime;
+		bundle.source_size = size;
+		bundle.source_hash = hash;
+
+		store(bundle);
+
+		return true;
+	}
+
+	static void store(const Bundle& bundle)
+	{
+		if (!isEnabled() || bundle.path.empty()) return;
+
+		string cache_path = getCachePath(bundle.path);
+		string tmp_path = cache_path + ".tmp";
+
+		{
+			ofstream os(tmp_path.c_str(), ios::binary | ios::trunc);
+			if (!os) return;
+			bundle.write(os);
+			if (!os.good()) return;
+		}
+
+		try
+		{
+			Poco::File(tmp_path).renameTo(cache_path);
+		}
+		catch (...)
+		{
+			ofLogWarning("ofxISF::BundleCache") << "couldn't write cache: " << cache_path;
+		}
+	}
+
+protected:
+
+	static string& getDirectoryRef()
+	{
+		static string dir;
+		return dir;
+	}
+
+	static string getCachePath(const string& abs_path)
+	{
+		return ofFilePath::join(ofToDataPath(getDirectory(), true), hash_to_string(hash_string(abs_path)) + ".isfb");
+	}
+
+	static bool read(const string& abs_path, Bundle& bundle)
+	{
+		string cache_path = getCachePath(abs_path);
+
+		ifstream is(cache_path.c_str(), ios::binary);
+		if (!is) return false;
+
+		// anything unreadable is a miss, the source gets parsed again
+		try
+		{
+			return bundle.read(is);
+		}
+		catch (...)
+		{
+			return false;
+		}
+	}
+};
+
+OFX_ISF_END_NAMESPACE
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "Constants.h"
+#include "Bundle.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Metadata of an ISF file, read from the header only. No GL involved.
+
+struct CatalogEntry
+{
+	string path;
+	long long source_mtime;
+	unsigned long long source_size;
+
+	string name;
+	string description;
+	string credit;
+	vector<string> categories;
+	vector<Input> inputs;
+
+	CatalogEntry() : source_mtime(0), source_size(0) {}
+
+	bool hasCategory(const string& category) const
+	{
+		return find(categories.begin(), categories.end(), category) != categories.end();
+	}
+
+	bool hasInputType(const string& type) const
+	{
+		for (int i = 0; i < inputs.size(); i++)
+			if (inputs[i].type == type) return true;
+		return false;
+	}
+};
+
+class Catalog
+{
+public:
+
+	// persistent index, empty path keeps the index in memory only
+	void setIndexPath(const string& path) { index_path = path; }
+	const string& getIndexPath() const { return index_path; }
+
+	// rescans the directory, only files whose mtime or size changed since
+	// the last scan (or the stored index) are parsed again. the catalog
+	// holds one directory, scanning another one replaces all entries.
+	bool scan(const string& path, const string& ext = "fs")
+	{
+		if (entries.empty() && !index_path.empty()) loadIndex();
+
+		map<string, size_t> known;
+		for (int i = 0; i < entries.size(); i++)
+			known[entries[i].path] = i;
+
+		ofDirectory dir;
+		dir.allowExt(ext);
+		dir.listDir(path);
+		dir.sort();
+
+		vector<CatalogEntry> result;
+		result.reserve(dir.size());
+
+		bool modified = false;
+
+		for (int i = 0; i < dir.size(); i++)
+		{
+			string abs_path = ofToDataPath(dir.getPath(i), true);
+
+			Poco::File file(abs_path);
+			long long mtime = file.getLastModified().epochMicroseconds();
+			unsigned long long size = file.getSize();
+
+			map<string, size_t>::iterator it = known.find(abs_path);
+			if (it != known.end())
+			{
+				const CatalogEntry &o = entries[it->second];
+				if (o.source_mtime == mtime && o.source_size == size)
+				{
+					result.push_back(o);
+					known.erase(it);
+					continue;
+				}
+			}
+
+			CatalogEntry entry;
+			if (!parse(abs_path, entry)) continue;
+
+			entry.source_mtime = mtime;
+			entry.source_size = size;
+			result.push_back(entry);
+
+			modified = true;
+		}
+
+		// remaining ones were deleted or are outside of this directory
+		if (!known.empty()) modified = true;
+
+		entries.swap(result);
+		updateCache();
+
+		if (modified && !index_path.empty()) saveIndex();
+
+		return true;
+	}
+
+	void clear()
+	{
+		entries.clear();
+		updateCache();
+	}
+
+	//
+
+	size_t size() const { return entries.size(); }
+	const CatalogEntry& getEntry(size_t index) const { return entries.at(index); }
+
+	const CatalogEntry* getEntry(const string& name) const
+	{
+		map<string, size_t>::const_iterator it = name_map.find(name);
+		if (it == name_map.end()) return NULL;
+		return &entries[it->second];
+	}
+
+	vector<string> getCategories() const
+	{
+		vector<string> result;
+		map<string, vector<size_t> >::const_iterator it = category_map.begin();
+		while (it != category_map.end())
+		{
+			result.push_back(it->first);
+			it++;
+		}
+		return result;
+	}
+
+	vector<const CatalogEntry*> findByCategory(const string& category) const
+	{
+		return lookup(category_map, category);
+	}
+
+	vector<const CatalogEntry*> findByInputType(const string& type) const
+	{
+		return lookup(input_type_map, type);
+	}
+
+	//
+
+	// false if the index is missing or unreadable, the next scan() then
+	// parses every file
+	bool loadIndex()
+	{
+		ifstream is(ofToDataPath(index_path, true).c_str(), ios::binary);
+		if (!is) return false;
+
+		try
+		{
+			if (read_index(is)) return true;
+		}
+		catch (...)
+		{
+		}
+
+		ofLogWarning("ofxISF::Catalog") << "unreadable index, rescanning: " << index_path;
+		return false;
+	}
+
+	bool saveIndex() const
+	{
+		string path = ofToDataPath(index_path, true);
+		string tmp_path = path + ".tmp";
+
+		{
+			ofstream os(tmp_path.c_str(), ios::binary | ios::trunc);
+			if (!os) return false;
+
+			BinaryWriter w(os);
+			w.write((unsigned int)MAGIC);
+			w.write((unsigned int)VERSION);
+			w.write((unsigned int)entries.size());
+
+			for (int i = 0; i < entries.size(); i++)
+			{
+				const CatalogEntry &o = entries[i];
+
+				w.write(o.path);
+				w.write(o.source_mtime);
+				w.write(o.source_size);
+				w.write(o.name);
+				w.write(o.description);
+				w.write(o.credit);
+				w.write(o.categories);
+
+				w.write((unsigned int)o.inputs.size());
+				for (int n = 0; n < o.inputs.size(); n++)
+					w.write(o.inputs[n]);
+			}
+
+			if (!w.good()) return false;
+		}
+
+		try
+		{
+			Poco::File(tmp_path).renameTo(path);
+		}
+		catch (...)
+		{
+			ofLogWarning("ofxISF::Catalog") << "couldn't write index: " << path;
+			return false;
+		}
+
+		return true;
+	}
+
+protected:
+
+	enum {
+		MAGIC = 0x43465349, // "ISFC"
+		VERSION = 1
+	};
+
+	string index_path;
+
+	vector<CatalogEntry> entries;
+
+	map<string, size_t> name_map;
+	map<string, vector<size_t> > category_map;
+	map<string, vector<size_t> > input_type_map;
+
+	bool read_index(istream &is)
+	{
+		BinaryReader r(is);
+
+		unsigned int magic = 0, version = 0, num = 0;
+		if (!r.read(magic) || magic != MAGIC) return false;
+		if (!r.read(version) || version != VERSION) return false;
+		if (!r.readCount(num, sizeof(unsigned int))) return false;
+
+		vector<CatalogEntry> result(num);
+		for (int i = 0; i < result.size(); i++)
+		{
+			CatalogEntry &o = result[i];
+
+			if (!r.read(o.path)) return false;
+			if (!r.read(o.source_mtime)) return false;
+			if (!r.read(o.source_size)) return false;
+			if (!r.read(o.name)) return false;
+			if (!r.read(o.description)) return false;
+			if (!r.read(o.credit)) return false;
+			if (!r.read(o.categories)) return false;
+
+			unsigned int num_inputs = 0;
+			if (!r.readCount(num_inputs, sizeof(unsigned int))) return false;
+			o.inputs.resize(num_inputs);
+			for (int n = 0; n < o.inputs.size(); n++)
+				if (!r.read(o.inputs[n])) return false;
+		}
+
+		entries.swap(result);
+		updateCache();
+
+		return true;
+	}
+
+	void updateCache()
+	{
+		name_map.clear();
+		category_map.clear();
+		input_type_map.clear();
+
+		for (int i = 0; i < entries.size(); i++)
+		{
+			const CatalogEntry &o = entries[i];
+			name_map[o.name] = i;
+
+			for (int n = 0; n < o.categories.size(); n++)
+			{
+				vector<size_t> &v = category_map[o.categories[n]];
+				if (v.empty() || v.back() != i) v.push_back(i);
+			}
+
+			for (int n = 0; n < o.inputs.size(); n++)
+			{
+				vector<size_t> &v = input_type_map[o.inputs[n].type];
+				if (v.empty() || v.back() != i) v.push_back(i);
+			}
+		}
+	}
+
+	vector<const CatalogEntry*> lookup(const map<string, vector<size_t> >& m, const string& key) const
+	{
+		vector<const CatalogEntry*> result;
+
+		map<string, vector<size_t> >::const_iterator it = m.find(key);
+		if (it == m.end()) return result;
+
+		const vector<size_t> &v = it->second;
+		result.reserve(v.size());
+		for (int i = 0; i < v.size(); i++)
+			result.push_back(&entries[v[i]]);
+
+		return result;
+	}
+
+	static bool parse(const string& abs_path, CatalogEntry& entry)
+	{
+		string data = ofBufferFromFile(abs_path).getText();
+
+		string header_directive, shader_directive;
+		if (!Bundle::parse_directive(data, header_directive, shader_directive)) return false;
+
+		Bundle bundle;
+
+		try
+		{
+			if (!bundle.parse_header(header_directive)) return false;
+		}
+		catch (...)
+		{
+			ofLogError("ofxISF::Catalog") << "couldn't parse header: " << abs_path;
+			return false;
+		}
+
+		entry.path = abs_path;
+		entry.name = ofFilePath::getBaseName(abs_path);
+		entry.description = bundle.description;
+		entry.credit = bundle.credit;
+		entry.categories = bundle.categories;
+		entry.inputs = bundle.inputs;
+
+		return true;
+	}
+};
+
+OFX_ISF_END_NAMESPACE
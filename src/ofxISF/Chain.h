@@ -8,7 +8,7 @@ class Chain
 {
 public:
 	
-	Chain() : input(NULL), result(NULL) {}
+	Chain() : input(NULL), result(NULL), pool(new RenderTargetPool), input_generation(0), skip_unchanged(false), profiling_enabled(false) {}
 	~Chain()
 	{
 		for (int i = 0; i < passes.size(); i++)
@@ -18,6 +18,10 @@ public:
 		
 		passes.clear();
 		pass_map.clear();
+		
+		for (int i = 0; i < mailboxes.size(); i++)
+			delete mailboxes[i];
+		mailboxes.clear();
 	}
 	
 	void setup(int width, int height, int internalformat = GL_RGB)
@@ -29,7 +33,12 @@ public:
 	
 	bool load(const string& path, bool enabled = true)
 	{
+		OFX_ISF_TRACE_SCOPE("Chain::load");
+		
 		Shader *shader = new Shader;
+		shader->setRenderTargetPool(pool);
+		shader->setSkipUnchanged(skip_unchanged);
+		shader->setClock(clock);
 		shader->setup(width, height, internalformat);
 		
 		if (!shader->load(path))
@@ -41,6 +50,9 @@ public:
 		ShaderPass *pass = new ShaderPass;
 		pass->enabled = enabled;
 		pass->shader = shader;
+		pass->source = NULL;
+		pass->source_generation = 0;
+		if (profiling_enabled) pass->timer = GpuTimer::Ref(new GpuTimer);
 
 		passes.push_back(pass);
 		pass_map[shader->getName()] = pass;
@@ -50,9 +62,28 @@ public:
 	
 	void update()
 	{
+		OFX_ISF_TRACE_SCOPE("Chain::update");
+		
+		for (int i = 0; i < mailboxes.size(); i++)
+			mailboxes[i]->drain();
+		
 		if (passes.empty()) return;
 		
+		if (profiling_enabled)
+		{
+			timer->collect();
+			for (int i = 0; i < passes.size(); i++)
+				passes[i]->timer->collect();
+			
+			timer->begin();
+		}
+		
 		ofTexture *tex = input;
+		Shader *previous = NULL;
+		
+		// identifies what the next stage reads, NULL for the chain input
+		const Shader *source = NULL;
+		unsigned int source_generation = input_generation;
 		
 		for (int i = 0; i < passes.size(); i++)
 		{
@@ -61,15 +92,38 @@ public:
 			
 			Shader *o = p.shader;
 			o->setImage(tex);
+			
+			if (p.source != source || p.source_generation != source_generation)
+			{
+				o->touchImage();
+				p.source = source;
+				p.source_generation = source_generation;
+			}
+			
+			if (profiling_enabled) p.timer->begin();
 			o->update();
+			if (profiling_enabled) p.timer->end();
+			
 			tex = &o->getTextureReference();
+			
+			source = o;
+			source_generation = o->getOutputGeneration();
+			
+			// read by this stage, the pool can hand it out again
+			if (previous) previous->releaseResult();
+			previous = o;
 		}
 		
+		if (profiling_enabled) timer->end();
+		
 		result = tex;
 	}
 	
 	inline void draw(float x, float y) { draw(x, y, width, height); }
 	
+	// output of the last enabled stage, valid after update()
+	ofTexture& getTextureReference() { return *result; }
+	
 	void draw(float x, float y, float width, float height)
 	{
 		if (result == NULL) return;
@@ -79,12 +133,80 @@ public:
 	//
 	
 	inline void setImage(ofTexture *img) { input = img; }
+	
+	// contents of the input texture changed, see Shader::setSkipUnchanged
+	inline void touchImage() { input_generation++; }
+	
+	// stages only render again when their input or uniforms changed
+	void setSkipUnchanged(bool v)
+	{
+		skip_unchanged = v;
+		for (int i = 0; i < passes.size(); i++)
+			passes[i]->shader->setSkipUnchanged(v);
+	}
+	
+	bool getSkipUnchanged() const { return skip_unchanged; }
+	
+	// source of TIME for all stages, see Shader::setClock
+	void setClock(const Clock::Ref& clock)
+	{
+		this->clock = clock;
+		for (int i = 0; i < passes.size(); i++)
+			passes[i]->shader->setClock(clock);
+	}
+	
+	const Clock::Ref& getClock() const { return clock; }
+	
+	// GPU time of the whole chain and of each stage, see GpuTimer. a
+	// skipped stage counts as (nearly) free, a disabled one isn't sampled.
+	// Shader::setProfilingEnabled breaks a stage down into its passes.
+	void setProfilingEnabled(bool v)
+	{
+		profiling_enabled = v;
+		if (!v) return;
+		
+		if (!timer) timer = GpuTimer::Ref(new GpuTimer);
+		for (int i = 0; i < passes.size(); i++)
+			if (!passes[i]->timer) passes[i]->timer = GpuTimer::Ref(new GpuTimer);
+	}
+	
+	bool getProfilingEnabled() const { return profiling_enabled; }
+	
+	GpuTimer::Stats getGpuTime() const
+	{
+		if (!timer) return GpuTimer::Stats();
+		return timer->getStats();
+	}
+	
+	GpuTimer::Stats getStageGpuTime(size_t index) const
+	{
+		if (index >= passes.size() || !passes[index]->timer) return GpuTimer::Stats();
+		return passes[index]->timer->getStats();
+	}
+	
+	GpuTimer::Stats getStageGpuTime(const string& name) const
+	{
+		if (!hasShader(name) || !pass_map[name]->timer) return GpuTimer::Stats();
+		return pass_map[name]->timer->getStats();
+	}
 	inline void setImage(ofTexture &img) { setImage(&img); }
 	inline void setImage(ofImage &img) { setImage(img.getTextureReference()); }
 	
 	inline float getWidth() const { return width; }
 	inline float getHeight() const { return height; }
 	
+	// shared by all stages, only the output of the last stage stays
+	// acquired between frames
+	const RenderTargetPool::Ref& getRenderTargetPool() const { return pool; }
+	
+	// accepts handles of any shader in the chain, see Shader::createMailbox
+	ParameterMailbox& createMailbox(size_t capacity = 1024)
+	{
+		ParameterMailbox *o = new ParameterMailbox(capacity);
+		mailboxes.push_back(o);
+		return *o;
+	}
+	
 	//
 	
 	inline size_t size() const { return passes.size(); }
@@ -126,6 +248,12 @@ protected:
 	struct ShaderPass {
 		bool enabled;
 		Shader *shader;
+		
+		// what was read last time, a change touches the input image
+		const Shader *source;
+		unsigned int source_generation;
+		
+		GpuTimer::Ref timer;
 	};
 	
 	vector<ShaderPass*> passes;
@@ -133,6 +261,17 @@ protected:
 	
 	ofTexture *input;
 	ofTexture *result;
+	
+	RenderTargetPool::Ref pool;
+	
+	unsigned int input_generation;
+	bool skip_unchanged;
+	Clock::Ref clock;
+	
+	bool profiling_enabled;
+	GpuTimer::Ref timer;
+	
+	vector<ParameterMailbox*> mailboxes;
 };
 
 OFX_ISF_END_NAMESPACE
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Constants.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Source of TIME. Shaders without a clock use ofGetElapsedTimef(), an
+// offline render sets a FixedStepClock so TIME only depends on the frame
+// number, not on how long rendering took.
+
+class Clock
+{
+public:
+
+	typedef Ref_<Clock> Ref;
+
+	virtual ~Clock() {}
+
+	// seconds, read once per Shader::update()
+	virtual float getTime() const = 0;
+};
+
+class SystemClock : public Clock
+{
+public:
+
+	float getTime() const { return ofGetElapsedTimef(); }
+};
+
+class FixedStepClock : public Clock
+{
+public:
+
+	FixedStepClock(float frame_rate = 60, float start_time = 0) : frame_rate(frame_rate), start_time(start_time), frame(0) {}
+
+	// computed from the frame number, doesn't accumulate rounding errors
+	float getTime() const { return start_time + (double)frame / frame_rate; }
+
+	void advance() { frame++; }
+
+	void setFrame(unsigned long long v) { frame = v; }
+	unsigned long long getFrame() const { return frame; }
+
+	void setFrameRate(float v) { frame_rate = v; }
+	float getFrameRate() const { return frame_rate; }
+
+	void setStartTime(float v) { start_time = v; }
+	float getStartTime() const { return start_time; }
+
+protected:
+
+	float frame_rate;
+	float start_time;
+	unsigned long long frame;
+};
+
+OFX_ISF_END_NAMESPACE
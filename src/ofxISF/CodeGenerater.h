@@ -3,8 +3,11 @@
 #include "Poco/RegularExpression.h"
 
 #include "Constants.h"
+#include "Trace.h"
 #include "Uniforms.h"
 
+#include <set>
+
 OFX_ISF_BEGIN_NAMESPACE
 
 #define _S(src) # src
@@ -14,70 +17,109 @@ class ImageDecl
 public:
 
 	ImageDecl() {}
-	ImageDecl(const Ref_<ImageUniform> &uniform) : uniform(uniform) {}
-
-	string getImgThisPixelString() const
+	ImageDecl(const Ref_<ImageUniform> &uniform) : uniform(uniform)
 	{
-		string s;
-		if (uniform->isRectangleTexture())
-			s = "IMG_THIS_PIXEL_RECT($IMAGE$, _$IMAGE$_pct)";
-		else
-			s = "IMG_THIS_PIXEL_2D($IMAGE$, _$IMAGE$_pct)";
-		ofStringReplace(s, "$IMAGE$", uniform->getName());
-		return s;
-	}
+		if (uniform->getPlanes() != ImageUniform::PLANES_RGB)
+		{
+			// (planes, chroma pct, matrix, scale, location), see CodeGenerator::get_yuv_helper
+			const string &name = uniform->getName();
+			string planes = uniform->getPlanes() == ImageUniform::PLANES_NV12 ? "_" + name + "_uv" : "_" + name + "_u, _" + name + "_v";
+			string args = getYUVFunctionName(uniform) + "(" + name + ", _" + name + "_pct, " + planes + ", _" + name + "_uv_pct, _" + name + "_yuv, ";
+
+			img_this_pixel = args + "vec2(1.0), vv_FragNormCoord)";
+			img_this_norm_pixel = img_this_pixel;
+			img_pixel = args + "1.0 / RENDERSIZE,";
+			img_norm_pixel = args + "vec2(1.0),";
+			return;
+		}
 
-	string getImgThisNormPixelString() const
-	{
-		string s;
-		if (uniform->isRectangleTexture())
-			s = "IMG_THIS_NORM_PIXEL_RECT($IMAGE$, _$IMAGE$_pct)";
-		else
-			s = "IMG_THIS_NORM_PIXEL_2D($IMAGE$, _$IMAGE$_pct)";
-		ofStringReplace(s, "$IMAGE$", uniform->getName());
-		return s;
-	}
+		const char *suffix = uniform->isRectangleTexture() ? "_RECT" : "_2D";
+		string args = "(" + uniform->getName() + ", _" + uniform->getName() + "_pct";
 
-	string getImgPixlString() const
-	{
-		string s;
-		if (uniform->isRectangleTexture())
-			s = "IMG_PIXEL_RECT($IMAGE$, _$IMAGE$_pct,";
-		else
-			s = "IMG_PIXEL_2D($IMAGE$, _$IMAGE$_pct,";
-		ofStringReplace(s, "$IMAGE$", uniform->getName());
-		return s;
+		img_this_pixel = string("IMG_THIS_PIXEL") + suffix + args + ")";
+		img_this_norm_pixel = string("IMG_THIS_NORM_PIXEL") + suffix + args + ")";
+		img_pixel = string("IMG_PIXEL") + suffix + args + ",";
+		img_norm_pixel = string("IMG_NORM_PIXEL") + suffix + args + ",";
 	}
 
-	string getImgNormPixelString() const
+	const string& getImgThisPixelString() const { return img_this_pixel; }
+	const string& getImgThisNormPixelString() const { return img_this_norm_pixel; }
+	const string& getImgPixlString() const { return img_pixel; }
+	const string& getImgNormPixelString() const { return img_norm_pixel; }
+
+	static string getYUVFunctionName(const Ref_<ImageUniform> &uniform)
 	{
-		string s;
-		if (uniform->isRectangleTexture())
-			s = "IMG_NORM_PIXEL_RECT($IMAGE$, _$IMAGE$_pct,";
-		else
-			s = "IMG_NORM_PIXEL_2D($IMAGE$, _$IMAGE$_pct,";
-		ofStringReplace(s, "$IMAGE$", uniform->getName());
-		return s;
+		string s = uniform->getPlanes() == ImageUniform::PLANES_NV12 ? "isf_yuv_nv12" : "isf_yuv_i420";
+		if (uniform->isChromaLuminanceAlpha()) s += "_la";
+		return s + (uniform->isRectangleTexture() ? "_rect" : "_2d");
 	}
 
 protected:
 
 	Ref_<ImageUniform> uniform;
+
+	string img_this_pixel;
+	string img_this_norm_pixel;
+	string img_pixel;
+	string img_norm_pixel;
 };
 
 class CodeGenerator
 {
 public:
 
-	CodeGenerator(Uniforms &uniforms) : uniforms(uniforms) {}
+	enum MacroProcessor
+	{
+		MACRO_LEXER,
+		MACRO_REGEX // previous implementation, kept for comparison
+	};
+
+	enum Profile
+	{
+		PROFILE_COMPATIBILITY, // GLSL 1.20, ftransform() and an immediate mode quad
+		PROFILE_CORE // GLSL 1.50, drawn with FullscreenTriangle
+	};
+
+	CodeGenerator(Uniforms &uniforms) : uniforms(uniforms), macro_processor(MACRO_LEXER), profile(PROFILE_COMPATIBILITY) {}
+
+	void setMacroProcessor(MacroProcessor v) { macro_processor = v; }
+	MacroProcessor getMacroProcessor() const { return macro_processor; }
+
+	void setProfile(Profile v) { profile = v; }
+	Profile getProfile() const { return profile; }
 
 	bool generate(const string& isf_glsl_code)
 	{
+		OFX_ISF_TRACE_SCOPE("CodeGenerator::generate");
+
 		if (!generate_shader(isf_glsl_code)) return false;
 
 		return true;
 	}
 
+	// restores previously generated code, e.g. from a Bundle
+	void setShader(const string& vert, const string& frag)
+	{
+		this->vert = vert;
+		this->frag = frag;
+	}
+
+	// whole identifier match, comments aren't skipped
+	static bool usesIdentifier(const string& source, const string& identifier)
+	{
+		size_t pos = source.find(identifier);
+		while (pos != string::npos)
+		{
+			size_t end = pos + identifier.size();
+			bool begins = pos == 0 || !is_ident_char(source[pos - 1]);
+			bool ends = end >= source.size() || !is_ident_char(source[end]);
+			if (begins && ends) return true;
+
+			pos = source.find(identifier, end);
+		}
+		return false;
+	}
+
 	const string& getVertexShader() const { return vert; }
 	const string& getFragmentShader() const { return frag; }
 	
@@ -95,6 +137,8 @@ public:
 protected:
 
 	Uniforms &uniforms;
+	MacroProcessor macro_processor;
+	Profile profile;
 
 	string vert;
 	string frag;
@@ -106,22 +150,78 @@ protected:
 		const vector<Ref_<ImageUniform> >& images = uniforms.getImageUniforms();
 		map<string, ImageDecl> image_decls;
 
+		// sampling and conversion of planar YUV inputs, one per kind
+		set<string> yuv_functions;
+		string yuv_helpers;
+
 		for (int i = 0; i < images.size(); i++)
 		{
 			const Ref_<ImageUniform> &uniform = images[i];
 			image_decls[uniform->getName()] = ImageDecl(uniform);
+
+			if (uniform->getPlanes() != ImageUniform::PLANES_RGB
+				&& yuv_functions.insert(ImageDecl::getYUVFunctionName(uniform)).second)
+			{
+				yuv_helpers += get_yuv_helper(uniform);
+			}
 		}
 
 		string isf_source = isf_glsl_code;
-		if (!process_lookup_macro(isf_source, image_decls)) return false;
+		if (macro_processor == MACRO_REGEX)
+		{
+			if (!process_lookup_macro_regex(isf_source, image_decls)) return false;
+		}
+		else
+		{
+			if (!process_lookup_macro(isf_source, image_decls)) return false;
+		}
 
 		string uniform_str;
 		for (int i = 0; i < uniforms.size(); i++)
 		{
-			Uniform::Ref o = uniforms.getUniform(i);
+			const Uniform::Ref &o = uniforms.getUniform(i);
+			if (o->isInBlock()) continue;
 			uniform_str += o->getUniform() + "\n";
 		}
+		
+		string header;
+		if (profile == PROFILE_CORE)
+			header = "#version 150\n";
+		
+		if (uniforms.isBlockEnabled())
+		{
+			// core in 1.40+
+			if (profile != PROFILE_CORE)
+				header += "#extension GL_ARB_uniform_buffer_object : enable\n";
+			uniform_str += uniforms.getBlockDeclaration();
+		}
 
+		if (profile == PROFILE_CORE)
+		{
+			vert = _S(
+				uniform int PASSINDEX;
+				uniform vec2 RENDERSIZE;
+				in vec2 position;
+				out vec2 vv_FragNormCoord;
+
+				void vv_vertShaderInit(void)
+				{
+					gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+					vv_FragNormCoord = position;
+				}
+
+				$UNIFORMS$
+
+				void main(void)
+				{
+					vv_vertShaderInit();
+				}
+			);
+
+			ofStringReplace(vert, "$UNIFORMS$", uniform_str);
+			vert = header + vert;
+		}
+		else
 		{
 			vert = _S(
 				uniform int PASSINDEX;
@@ -143,6 +243,7 @@ protected:
 			);
 
 			ofStringReplace(vert, "$UNIFORMS$", uniform_str);
+			vert = header + vert;
 		}
 
 		{
@@ -191,18 +292,222 @@ protected:
 					return IMG_THIS_NORM_PIXEL_RECT(sampler, pct);
 				}
 
+				$YUV_HELPERS$
+
 				$ISF_SOURCE$
 			);
 
+			if (profile == PROFILE_CORE)
+			{
+				// 1.20 names used by the helpers above and by ISF sources
+				header +=
+					"#define varying in\n"
+					"#define texture2D texture\n"
+					"#define texture2DRect texture\n"
+					"out vec4 isf_FragColor;\n"
+					"#define gl_FragColor isf_FragColor\n";
+			}
+
 			ofStringReplace(frag, "$UNIFORMS$", uniform_str);
+			ofStringReplace(frag, "$YUV_HELPERS$", yuv_helpers);
 			ofStringReplace(frag, "$ISF_SOURCE$", isf_source);
+			frag = header + frag;
 		}
 
 		return true;
 	}
 
+	// luma and chroma share the normalized coordinate, each plane scales it
+	// by its own pct (texel size for rectangle textures)
+	string get_yuv_helper(const Ref_<ImageUniform> &uniform) const
+	{
+		string s;
+
+		if (uniform->getPlanes() == ImageUniform::PLANES_NV12)
+		{
+			s = _S(
+				vec4 $FUNC$($SAMPLER$ y, vec2 y_pct, $SAMPLER$ uv, vec2 uv_pct, mat4 m, vec2 scale, vec2 loc)
+				{
+					vec2 coord = loc * scale;
+					vec4 yuv = vec4($TEXTURE$(y, coord * y_pct).r, $TEXTURE$(uv, coord * uv_pct).$UV$, 1.0);
+					return vec4((m * yuv).rgb, 1.0);
+				}
+			);
+		}
+		else
+		{
+			s = _S(
+				vec4 $FUNC$($SAMPLER$ y, vec2 y_pct, $SAMPLER$ u, $SAMPLER$ v, vec2 uv_pct, mat4 m, vec2 scale, vec2 loc)
+				{
+					vec2 coord = loc * scale;
+					vec4 yuv = vec4($TEXTURE$(y, coord * y_pct).r, $TEXTURE$(u, coord * uv_pct).r, $TEXTURE$(v, coord * uv_pct).r, 1.0);
+					return vec4((m * yuv).rgb, 1.0);
+				}
+			);
+		}
+
+		bool rect = uniform->isRectangleTexture();
+		ofStringReplace(s, "$FUNC$", ImageDecl::getYUVFunctionName(uniform));
+		ofStringReplace(s, "$SAMPLER$", rect ? "sampler2DRect" : "sampler2D");
+		ofStringReplace(s, "$TEXTURE$", rect ? "texture2DRect" : "texture2D");
+
+		// by the chroma texture's format, GL_LUMINANCE_ALPHA only exists in compat
+		ofStringReplace(s, "$UV$", uniform->isChromaLuminanceAlpha() ? "ra" : "rg");
+
+		return s + "\n";
+	}
+
+	enum LookupMacro
+	{
+		LOOKUP_NONE,
+		LOOKUP_THIS_PIXEL,
+		LOOKUP_THIS_NORM_PIXEL,
+		LOOKUP_PIXEL,
+		LOOKUP_NORM_PIXEL
+	};
+
+	static bool is_ident_char(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+
+	static bool is_space(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+	}
+
+	static LookupMacro get_lookup_macro(const char *s, size_t len)
+	{
+		if (len < 9 || s[0] != 'I') return LOOKUP_NONE;
+		if (len == 14 && memcmp(s, "IMG_THIS_PIXEL", len) == 0) return LOOKUP_THIS_PIXEL;
+		if (len == 19 && memcmp(s, "IMG_THIS_NORM_PIXEL", len) == 0) return LOOKUP_THIS_NORM_PIXEL;
+		if (len == 9 && memcmp(s, "IMG_PIXEL", len) == 0) return LOOKUP_PIXEL;
+		if (len == 14 && memcmp(s, "IMG_NORM_PIXEL", len) == 0) return LOOKUP_NORM_PIXEL;
+		return LOOKUP_NONE;
+	}
+
+	// single pass over the source, comments are copied through untouched
+	// and the image argument may contain nested parentheses
 	bool process_lookup_macro(string& isf_source, map<string, ImageDecl> &image_decls)
 	{
+		OFX_ISF_TRACE_SCOPE("CodeGenerator::process_lookup_macro");
+
+		const char *src = isf_source.data();
+		const size_t n = isf_source.size();
+
+		string out;
+		out.reserve(n + n / 4);
+
+		size_t i = 0;
+		while (i < n)
+		{
+			const char c = src[i];
+
+			if (c == '/' && i + 1 < n && src[i + 1] == '/')
+			{
+				size_t e = isf_source.find('\n', i);
+				if (e == string::npos) e = n;
+				out.append(src + i, e - i);
+				i = e;
+				continue;
+			}
+
+			if (c == '/' && i + 1 < n && src[i + 1] == '*')
+			{
+				size_t e = isf_source.find("*/", i + 2);
+				e = (e == string::npos) ? n : e + 2;
+				out.append(src + i, e - i);
+				i = e;
+				continue;
+			}
+
+			if (!is_ident_char(c))
+			{
+				out += c;
+				i++;
+				continue;
+			}
+
+			// identifier or number
+			size_t begin = i;
+			while (i < n && is_ident_char(src[i])) i++;
+
+			LookupMacro macro = get_lookup_macro(src + begin, i - begin);
+
+			size_t p = i;
+			while (p < n && is_space(src[p])) p++;
+
+			if (macro == LOOKUP_NONE || p >= n || src[p] != '(')
+			{
+				out.append(src + begin, i - begin);
+				continue;
+			}
+
+			// first argument, up to the top level ',' or ')'
+			size_t arg_begin = ++p;
+			int depth = 0;
+			while (p < n)
+			{
+				const char a = src[p];
+				if (a == '(') depth++;
+				else if (a == ')')
+				{
+					if (depth == 0) break;
+					depth--;
+				}
+				else if (a == ',' && depth == 0) break;
+				p++;
+			}
+
+			if (p >= n)
+			{
+				ofLogError("ofxISF::CodeGenerator") << "unterminated lookup macro: " << string(src + begin, i - begin);
+				return false;
+			}
+
+			size_t arg_end = p;
+			while (arg_begin < arg_end && is_space(src[arg_begin])) arg_begin++;
+			while (arg_end > arg_begin && is_space(src[arg_end - 1])) arg_end--;
+
+			string image_name(src + arg_begin, arg_end - arg_begin);
+
+			map<string, ImageDecl>::iterator it = image_decls.find(image_name);
+			if (it == image_decls.end())
+			{
+				ofLogError("ofxISF::CodeGenerator") << "image name mismatch: " << image_name;
+				return false;
+			}
+
+			const ImageDecl &image_decl = it->second;
+			const bool this_pixel = macro == LOOKUP_THIS_PIXEL || macro == LOOKUP_THIS_NORM_PIXEL;
+
+			if (this_pixel != (src[p] == ')'))
+			{
+				ofLogError("ofxISF::CodeGenerator") << "wrong number of arguments: " << string(src + begin, i - begin);
+				return false;
+			}
+
+			switch (macro)
+			{
+				case LOOKUP_THIS_PIXEL: out += image_decl.getImgThisPixelString(); break;
+				case LOOKUP_THIS_NORM_PIXEL: out += image_decl.getImgThisNormPixelString(); break;
+				case LOOKUP_PIXEL: out += image_decl.getImgPixlString(); break;
+				case LOOKUP_NORM_PIXEL: out += image_decl.getImgNormPixelString(); break;
+				default: break;
+			}
+
+			// the remaining arguments go through the lexer as usual
+			i = p + 1;
+		}
+
+		isf_source.swap(out);
+		return true;
+	}
+
+	bool process_lookup_macro_regex(string& isf_source, map<string, ImageDecl> &image_decls)
+	{
+		OFX_ISF_TRACE_SCOPE("CodeGenerator::process_lookup_macro");
+
 		{
 			string pattern = "(IMG_THIS_PIXEL|IMG_THIS_NORM_PIXEL)\\s*\\(\\s*(.*?)\\s*\\)";
 
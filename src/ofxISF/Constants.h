@@ -3,8 +3,35 @@
 #define OFX_ISF_BEGIN_NAMESPACE namespace ofx { namespace ISF {
 #define OFX_ISF_END_NAMESPACE } }
 
+#ifdef _MSC_VER
+#define OFX_ISF_MEMORY_BARRIER() MemoryBarrier()
+#define OFX_ISF_CAS_POINTER(dst, expected, desired) (InterlockedCompareExchangePointer((PVOID volatile*)(dst), (desired), (expected)) == (expected))
+#define OFX_ISF_CAS_INT(dst, expected, desired) (InterlockedCompareExchange((LONG volatile*)(dst), (desired), (expected)) == (expected))
+#define OFX_ISF_THREAD_LOCAL __declspec(thread)
+#else
+#define OFX_ISF_MEMORY_BARRIER() __sync_synchronize()
+#define OFX_ISF_CAS_POINTER(dst, expected, desired) __sync_bool_compare_and_swap((dst), (expected), (desired))
+#define OFX_ISF_CAS_INT(dst, expected, desired) __sync_bool_compare_and_swap((dst), (expected), (desired))
+#define OFX_ISF_THREAD_LOCAL __thread
+#endif
+
 OFX_ISF_BEGIN_NAMESPACE
 
+template <typename T>
+inline T load_acquire(const volatile T& v)
+{
+	T o = v;
+	OFX_ISF_MEMORY_BARRIER();
+	return o;
+}
+
+template <typename T>
+inline void store_release(volatile T& v, T o)
+{
+	OFX_ISF_MEMORY_BARRIER();
+	v = o;
+}
+
 template <typename T>
 struct Ref_ : public ofPtr<T>
 {
@@ -17,30 +44,72 @@ struct Ref_ : public ofPtr<T>
 	Ref_<TT> cast() const { return dynamic_pointer_cast<TT>(*this); }
 };
 
+// stable type ids for the uniform value types, unsupported types don't compile
 template <typename T>
-struct Type2Int
+struct Type2Int;
+
+template <> struct Type2Int<bool> { enum { value = 1 }; };
+template <> struct Type2Int<float> { enum { value = 2 }; };
+template <> struct Type2Int<ofFloatColor> { enum { value = 3 }; };
+template <> struct Type2Int<ofVec2f> { enum { value = 4 }; };
+template <> struct Type2Int<ofTexture*> { enum { value = 5 }; };
+
+inline unsigned long long hash_string(const string& data, unsigned long long seed = 14695981039346656037ULL)
 {
-	static unsigned int value()
+	// FNV-1a
+	unsigned long long h = seed;
+	for (size_t i = 0; i < data.size(); i++)
 	{
-		static size_t m = 0;
-		return (unsigned int)&m;
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
 	}
-};
+	return h;
+}
+
+inline string hash_to_string(unsigned long long h)
+{
+	char buf[17];
+	snprintf(buf, sizeof(buf), "%016llx", h);
+	return buf;
+}
 
 struct Input {
 	string name, type;
+	
+	float default_value[4];
+	float min_value[4], max_value[4];
+	bool has_range;
+	
+	Input() : has_range(false)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			default_value[i] = 0;
+			min_value[i] = 0;
+			max_value[i] = 0;
+		}
+	}
 };
 
 struct PresistentBuffer
 {
 	string name;
-	float width, height;
+	
+	// size expressions, empty means render size
+	string width, height;
+	
+	// GL_RGBA32F instead of the Shader's internalformat
+	bool float_precision;
+	
+	PresistentBuffer() : float_precision(false) {}
 };
 
 struct Pass
 {
 	string target;
-	float width, height;
+	
+	// size expressions, empty means the size of the target
+	string width, height;
 };
 
 OFX_ISF_END_NAMESPACE
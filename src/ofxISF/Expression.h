@@ -0,0 +1,310 @@
+#pragma once
+
+#include "Constants.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Size expressions of ISF passes and buffers, e.g. "floor($WIDTH / $blur)".
+//
+// Compiled once to a small stack bytecode. Variables ($WIDTH, $HEIGHT and
+// input names) are collected into a table shared by the expressions of one
+// target, evaluate() reads their values by index.
+
+class Expression
+{
+public:
+
+	// variables referenced by the expression are appended to the table
+	// unless already there
+	bool compile(const string& source, vector<string>& variables)
+	{
+		code.clear();
+		error.clear();
+
+		src = source.c_str();
+		pos = 0;
+		this->variables = &variables;
+
+		int depth = 0;
+		bool ok = parse_expression(depth) && expect_end();
+
+		this->variables = NULL;
+
+		if (!ok)
+		{
+			code.clear();
+			ofLogError("ofxISF::Expression") << error << ": " << source;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool empty() const { return code.empty(); }
+	const string& getError() const { return error; }
+
+	float evaluate(const float *variables) const
+	{
+		float stack[MAX_STACK];
+		int sp = 0;
+
+		for (int i = 0; i < code.size(); i++)
+		{
+			const Op &op = code[i];
+
+			switch (op.code)
+			{
+				case OP_CONST: stack[sp++] = op.value; break;
+				case OP_LOAD: stack[sp++] = variables[op.index]; break;
+				case OP_NEG: stack[sp - 1] = -stack[sp - 1]; break;
+
+				case OP_ADD: sp--; stack[sp - 1] += stack[sp]; break;
+				case OP_SUB: sp--; stack[sp - 1] -= stack[sp]; break;
+				case OP_MUL: sp--; stack[sp - 1] *= stack[sp]; break;
+				case OP_DIV: sp--; stack[sp - 1] = stack[sp] != 0 ? stack[sp - 1] / stack[sp] : 0; break;
+
+				case OP_MIN: sp--; stack[sp - 1] = std::min(stack[sp - 1], stack[sp]); break;
+				case OP_MAX: sp--; stack[sp - 1] = std::max(stack[sp - 1], stack[sp]); break;
+				case OP_POW: sp--; stack[sp - 1] = powf(stack[sp - 1], stack[sp]); break;
+
+				case OP_FLOOR: stack[sp - 1] = floorf(stack[sp - 1]); break;
+				case OP_CEIL: stack[sp - 1] = ceilf(stack[sp - 1]); break;
+				case OP_ROUND: stack[sp - 1] = floorf(stack[sp - 1] + 0.5f); break;
+				case OP_ABS: stack[sp - 1] = fabsf(stack[sp - 1]); break;
+				case OP_SQRT: stack[sp - 1] = sqrtf(std::max(stack[sp - 1], 0.0f)); break;
+			}
+		}
+
+		return sp == 1 ? stack[0] : 0;
+	}
+
+protected:
+
+	enum {
+		MAX_STACK = 32
+	};
+
+	enum OpCode
+	{
+		OP_CONST,
+		OP_LOAD,
+		OP_NEG,
+		OP_ADD,
+		OP_SUB,
+		OP_MUL,
+		OP_DIV,
+		OP_MIN,
+		OP_MAX,
+		OP_POW,
+		OP_FLOOR,
+		OP_CEIL,
+		OP_ROUND,
+		OP_ABS,
+		OP_SQRT
+	};
+
+	struct Op
+	{
+		OpCode code;
+		float value;
+		int index;
+
+		Op(OpCode code, float value = 0, int index = 0) : code(code), value(value), index(index) {}
+	};
+
+	vector<Op> code;
+	string error;
+
+	// compile state
+	const char *src;
+	size_t pos;
+	vector<string> *variables;
+
+	//
+
+	void emit(OpCode code, float value = 0, int index = 0)
+	{
+		this->code.push_back(Op(code, value, index));
+	}
+
+	bool fail(const string& message)
+	{
+		if (error.empty()) error = message + " at " + ofToString(pos);
+		return false;
+	}
+
+	void skip_space()
+	{
+		while (src[pos] == ' ' || src[pos] == '\t' || src[pos] == '\n' || src[pos] == '\r') pos++;
+	}
+
+	bool accept(char c)
+	{
+		skip_space();
+		if (src[pos] != c) return false;
+		pos++;
+		return true;
+	}
+
+	bool expect_end()
+	{
+		skip_space();
+		if (src[pos] != '\0') return fail("unexpected character");
+		return true;
+	}
+
+	static bool is_ident_char(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+
+	string read_ident()
+	{
+		size_t begin = pos;
+		while (is_ident_char(src[pos])) pos++;
+		return string(src + begin, pos - begin);
+	}
+
+	// depth tracks the stack height at run time, checked against MAX_STACK
+
+	bool push(int& depth)
+	{
+		depth++;
+		if (depth > MAX_STACK) return fail("expression too complex");
+		return true;
+	}
+
+	// expression := term (('+' | '-') term)*
+	bool parse_expression(int& depth)
+	{
+		if (!parse_term(depth)) return false;
+
+		while (true)
+		{
+			OpCode op;
+			if (accept('+')) op = OP_ADD;
+			else if (accept('-')) op = OP_SUB;
+			else break;
+
+			if (!parse_term(depth)) return false;
+			emit(op);
+			depth--;
+		}
+
+		return true;
+	}
+
+	// term := unary (('*' | '/') unary)*
+	bool parse_term(int& depth)
+	{
+		if (!parse_unary(depth)) return false;
+
+		while (true)
+		{
+			OpCode op;
+			if (accept('*')) op = OP_MUL;
+			else if (accept('/')) op = OP_DIV;
+			else break;
+
+			if (!parse_unary(depth)) return false;
+			emit(op);
+			depth--;
+		}
+
+		return true;
+	}
+
+	// unary := ('-' | '+') unary | primary
+	bool parse_unary(int& depth)
+	{
+		if (accept('-'))
+		{
+			if (!parse_unary(depth)) return false;
+			emit(OP_NEG);
+			return true;
+		}
+
+		if (accept('+')) return parse_unary(depth);
+
+		return parse_primary(depth);
+	}
+
+	// primary := number | '$' name | function '(' args ')' | '(' expression ')'
+	bool parse_primary(int& depth)
+	{
+		skip_space();
+
+		const char c = src[pos];
+
+		if ((c >= '0' && c <= '9') || c == '.')
+		{
+			char *end = NULL;
+			float v = strtof(src + pos, &end);
+			if (end == src + pos) return fail("invalid number");
+			pos = end - src;
+
+			if (!push(depth)) return false;
+			emit(OP_CONST, v);
+			return true;
+		}
+
+		if (c == '$')
+		{
+			pos++;
+			string name = read_ident();
+			if (name.empty()) return fail("missing variable name");
+
+			vector<string>::iterator it = find(variables->begin(), variables->end(), name);
+			int index = it - variables->begin();
+			if (it == variables->end()) variables->push_back(name);
+
+			if (!push(depth)) return false;
+			emit(OP_LOAD, 0, index);
+			return true;
+		}
+
+		if (c == '(')
+		{
+			pos++;
+			if (!parse_expression(depth)) return false;
+			if (!accept(')')) return fail("missing ')'");
+			return true;
+		}
+
+		if (is_ident_char(c))
+		{
+			string name = read_ident();
+
+			OpCode op;
+			int num_args = 1;
+
+			if (name == "floor") op = OP_FLOOR;
+			else if (name == "ceil") op = OP_CEIL;
+			else if (name == "round") op = OP_ROUND;
+			else if (name == "abs") op = OP_ABS;
+			else if (name == "sqrt") op = OP_SQRT;
+			else if (name == "min") { op = OP_MIN; num_args = 2; }
+			else if (name == "max") { op = OP_MAX; num_args = 2; }
+			else if (name == "pow") { op = OP_POW; num_args = 2; }
+			else return fail("unknown function '" + name + "'");
+
+			if (!accept('(')) return fail("missing '('");
+
+			for (int i = 0; i < num_args; i++)
+			{
+				if (i > 0 && !accept(',')) return fail("missing ','");
+				if (!parse_expression(depth)) return false;
+			}
+
+			if (!accept(')')) return fail("missing ')'");
+
+			emit(op);
+			depth -= num_args - 1;
+			return true;
+		}
+
+		return fail("unexpected character");
+	}
+};
+
+OFX_ISF_END_NAMESPACE
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "Constants.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// GPU time of a span of GL commands, in milliseconds.
+//
+// begin()/end() write GL_TIMESTAMP queries into a small ring, results are
+// picked up once the GPU made them available, so reading never stalls. A
+// frame is dropped instead when the ring is still full of pending ones.
+// Timestamps rather than GL_TIME_ELAPSED since elapsed queries can't nest
+// and Chain stages wrap the passes of their Shader. GL thread only.
+
+class GpuTimer
+{
+public:
+
+	typedef Ref_<GpuTimer> Ref;
+
+	struct Stats
+	{
+		float min, mean, p95, max;
+		size_t samples;
+
+		Stats() : min(0), mean(0), p95(0), max(0), samples(0) {}
+	};
+
+	enum {
+		RING_SIZE = 4
+	};
+
+	GpuTimer(size_t window = 120) : window(max<size_t>(window, 1)), cursor(0), head(0), num_pending(0), active(false), num_dropped(0)
+	{
+		queries[0] = 0;
+	}
+
+	~GpuTimer()
+	{
+		if (queries[0]) glDeleteQueries(RING_SIZE * 2, queries);
+	}
+
+	static bool isSupported()
+	{
+		return GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	}
+
+	void begin()
+	{
+		if (active || !isSupported()) return;
+
+		collect();
+
+		if (num_pending == RING_SIZE)
+		{
+			num_dropped++;
+			return;
+		}
+
+		if (queries[0] == 0) glGenQueries(RING_SIZE * 2, queries);
+
+		glQueryCounter(queries[head * 2], GL_TIMESTAMP);
+		active = true;
+	}
+
+	void end()
+	{
+		if (!active) return;
+
+		glQueryCounter(queries[head * 2 + 1], GL_TIMESTAMP);
+
+		head = (head + 1) % RING_SIZE;
+		num_pending++;
+		active = false;
+	}
+
+	// moves available results into the window, doesn't wait for the GPU
+	void collect()
+	{
+		while (num_pending > 0)
+		{
+			int slot = (head + RING_SIZE - num_pending) % RING_SIZE;
+
+			GLint available = 0;
+			glGetQueryObjectiv(queries[slot * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) break;
+
+			GLuint64 t0 = 0, t1 = 0;
+			glGetQueryObjectui64v(queries[slot * 2], GL_QUERY_RESULT, &t0);
+			glGetQueryObjectui64v(queries[slot * 2 + 1], GL_QUERY_RESULT, &t1);
+
+			add_sample(t1 > t0 ? (t1 - t0) / 1000000.0 : 0);
+			num_pending--;
+		}
+	}
+
+	// over the last window samples, computed on demand
+	Stats getStats() const
+	{
+		Stats o;
+		o.samples = samples.size();
+		if (samples.empty()) return o;
+
+		o.min = samples[0];
+		o.max = samples[0];
+
+		double sum = 0;
+		for (int i = 0; i < samples.size(); i++)
+		{
+			o.min = std::min(o.min, samples[i]);
+			o.max = std::max(o.max, samples[i]);
+			sum += samples[i];
+		}
+		o.mean = sum / samples.size();
+
+		vector<float> sorted(samples);
+		size_t index = (size_t)ceil(sorted.size() * 0.95) - 1;
+		nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		o.p95 = sorted[index];
+
+		return o;
+	}
+
+	// frames skipped because the ring was full
+	size_t getNumDropped() const { return num_dropped; }
+
+	void reset()
+	{
+		samples.clear();
+		cursor = 0;
+		num_dropped = 0;
+	}
+
+protected:
+
+	GLuint queries[RING_SIZE * 2];
+
+	vector<float> samples;
+	size_t window;
+	size_t cursor;
+
+	int head;
+	int num_pending;
+	bool active;
+
+	size_t num_dropped;
+
+	void add_sample(float ms)
+	{
+		if (samples.size() < window)
+		{
+			samples.push_back(ms);
+			return;
+		}
+
+		samples[cursor] = ms;
+		cursor = (cursor + 1) % window;
+	}
+
+private:
+
+	GpuTimer(const GpuTimer&);
+	GpuTimer& operator=(const GpuTimer&);
+};
+
+OFX_ISF_END_NAMESPACE
@@ -0,0 +1,409 @@
+#pragma once
+
+#include "Shader.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Render graph of Shaders. The output of any node can feed any image
+// input of another node, external textures can be bound to inputs too.
+// update() renders only the nodes the requested outputs depend on, in
+// topological order, and returns intermediates to the shared pool as soon
+// as their last consumer has rendered.
+
+class Graph
+{
+public:
+
+	typedef int NodeID;
+
+	Graph() : width(0), height(0), internalformat(GL_RGB), pool(new RenderTargetPool), schedule_dirty(true), external_generation(0), skip_unchanged(false) {}
+
+	~Graph()
+	{
+		for (int i = 0; i < nodes.size(); i++)
+			delete nodes[i].shader;
+		nodes.clear();
+
+		for (int i = 0; i < mailboxes.size(); i++)
+			delete mailboxes[i];
+		mailboxes.clear();
+	}
+
+	void setup(int width, int height, int internalformat = GL_RGB)
+	{
+		this->width = width;
+		this->height = height;
+		this->internalformat = internalformat;
+	}
+
+	// returns -1 on failure
+	NodeID addNode(const string& path)
+	{
+		OFX_ISF_TRACE_SCOPE("Graph::addNode");
+
+		Shader *shader = new Shader;
+		shader->setRenderTargetPool(pool);
+		shader->setSkipUnchanged(skip_unchanged);
+		shader->setClock(clock);
+		shader->setup(width, height, internalformat);
+
+		if (!shader->load(path))
+		{
+			delete shader;
+			return -1;
+		}
+
+		Node node;
+		node.shader = shader;
+		nodes.push_back(node);
+
+		schedule_dirty = true;
+		return nodes.size() - 1;
+	}
+
+	// empty input name means the default image input of the node
+	bool connect(NodeID source, NodeID target, const string& input = "")
+	{
+		if (!isValid(source) || !isValid(target)) return false;
+
+		string name = resolve_input(target, input);
+		if (name.empty()) return false;
+
+		if (source == target || depends_on(source, target))
+		{
+			ofLogError("ofxISF::Graph") << "connection would create a cycle";
+			return false;
+		}
+
+		Edge &e = nodes[target].inputs[name];
+		e = Edge();
+		e.source = source;
+
+		schedule_dirty = true;
+		return true;
+	}
+
+	bool connect(ofTexture *external, NodeID target, const string& input = "")
+	{
+		if (!isValid(target)) return false;
+
+		string name = resolve_input(target, input);
+		if (name.empty()) return false;
+
+		Edge &e = nodes[target].inputs[name];
+		e = Edge();
+		e.external = external;
+
+		schedule_dirty = true;
+		return true;
+	}
+
+	void disconnect(NodeID target, const string& input = "")
+	{
+		if (!isValid(target)) return;
+
+		string name = input.empty() ? nodes[target].shader->getDefaultImageInputName() : input;
+		nodes[target].inputs.erase(name);
+
+		schedule_dirty = true;
+	}
+
+	// nodes that aren't outputs and no output depends on are culled
+	void addOutput(NodeID node)
+	{
+		if (!isValid(node) || isOutput(node)) return;
+
+		outputs.push_back(node);
+		schedule_dirty = true;
+	}
+
+	void removeOutput(NodeID node)
+	{
+		vector<NodeID>::iterator it = find(outputs.begin(), outputs.end(), node);
+		if (it == outputs.end()) return;
+
+		nodes[node].shader->releaseResult();
+		outputs.erase(it);
+		schedule_dirty = true;
+	}
+
+	bool isOutput(NodeID node) const
+	{
+		return find(outputs.begin(), outputs.end(), node) != outputs.end();
+	}
+
+	const vector<NodeID>& getOutputs() const { return outputs; }
+
+	void update()
+	{
+		OFX_ISF_TRACE_SCOPE("Graph::update");
+
+		for (int i = 0; i < mailboxes.size(); i++)
+			mailboxes[i]->drain();
+
+		if (schedule_dirty) update_schedule();
+
+		vector<int> remaining = num_consumers;
+
+		for (int i = 0; i < schedule.size(); i++)
+		{
+			Node &node = nodes[schedule[i]];
+
+			map<string, Edge>::iterator it = node.inputs.begin();
+			while (it != node.inputs.end())
+			{
+				Edge &e = it->second;
+				ofTexture *tex = e.source >= 0 ? &nodes[e.source].shader->getTextureReference() : e.external;
+				node.shader->setImage(it->first, tex);
+
+				unsigned int generation = e.source >= 0 ? nodes[e.source].shader->getOutputGeneration() : external_generation;
+				if (!e.seen || e.seen_generation != generation)
+				{
+					node.shader->touchImage(it->first);
+					e.seen = true;
+					e.seen_generation = generation;
+				}
+				it++;
+			}
+
+			node.shader->update();
+
+			// the pool can hand out sources nobody else reads this frame
+			it = node.inputs.begin();
+			while (it != node.inputs.end())
+			{
+				NodeID source = it->second.source;
+				if (source >= 0 && --remaining[source] == 0)
+					nodes[source].shader->releaseResult();
+				it++;
+			}
+		}
+	}
+
+	inline void draw(float x, float y) { draw(x, y, width, height); }
+
+	// draws the first output
+	void draw(float x, float y, float width, float height)
+	{
+		if (outputs.empty()) return;
+		getTextureReference(outputs[0]).draw(x, y, width, height);
+	}
+
+	//
+
+	inline bool isValid(NodeID node) const { return node >= 0 && node < nodes.size(); }
+	inline size_t size() const { return nodes.size(); }
+
+	Shader* getShader(NodeID node) const { return isValid(node) ? nodes[node].shader : NULL; }
+
+	// valid for outputs until the next update()
+	ofTexture& getTextureReference(NodeID node) { return nodes[node].shader->getTextureReference(); }
+
+	// render order of the last update(), culled nodes are left out
+	const vector<NodeID>& getSchedule()
+	{
+		if (schedule_dirty) update_schedule();
+		return schedule;
+	}
+
+	const RenderTargetPool::Ref& getRenderTargetPool() const { return pool; }
+
+	// contents of the external textures changed, see Shader::setSkipUnchanged
+	void touchImages() { external_generation++; }
+
+	// nodes only render again when their inputs or uniforms changed
+	void setSkipUnchanged(bool v)
+	{
+		skip_unchanged = v;
+		for (int i = 0; i < nodes.size(); i++)
+			nodes[i].shader->setSkipUnchanged(v);
+	}
+
+	bool getSkipUnchanged() const { return skip_unchanged; }
+
+	// source of TIME for all nodes, see Shader::setClock
+	void setClock(const Clock::Ref& clock)
+	{
+		this->clock = clock;
+		for (int i = 0; i < nodes.size(); i++)
+			nodes[i].shader->setClock(clock);
+	}
+
+	const Clock::Ref& getClock() const { return clock; }
+
+	// accepts handles of any shader in the graph, see Shader::createMailbox
+	ParameterMailbox& createMailbox(size_t capacity = 1024)
+	{
+		ParameterMailbox *o = new ParameterMailbox(capacity);
+		mailboxes.push_back(o);
+		return *o;
+	}
+
+	inline float getWidth() const { return width; }
+	inline float getHeight() const { return height; }
+
+protected:
+
+	struct Edge
+	{
+		NodeID source; // -1 for external textures
+		ofTexture *external;
+
+		// output generation of the source when it was last read
+		bool seen;
+		unsigned int seen_generation;
+
+		Edge() : source(-1), external(NULL), seen(false), seen_generation(0) {}
+	};
+
+	struct Node
+	{
+		Shader *shader;
+		map<string, Edge> inputs;
+
+		Node() : shader(NULL) {}
+	};
+
+	int width, height;
+	int internalformat;
+
+	vector<Node> nodes;
+	vector<NodeID> outputs;
+
+	RenderTargetPool::Ref pool;
+
+	bool schedule_dirty;
+	vector<NodeID> schedule;
+	vector<int> num_consumers;
+
+	vector<ParameterMailbox*> mailboxes;
+
+	unsigned int external_generation;
+	bool skip_unchanged;
+	Clock::Ref clock;
+
+	//
+
+	string resolve_input(NodeID target, const string& input) const
+	{
+		const Shader *shader = nodes[target].shader;
+		string name = input.empty() ? shader->getDefaultImageInputName() : input;
+
+		if (name.empty() || !shader->hasImage(name))
+		{
+			ofLogError("ofxISF::Graph") << "no image input '" << input << "' in " << shader->getName();
+			return "";
+		}
+
+		return name;
+	}
+
+	// true if node reads, directly or not, the output of source
+	bool depends_on(NodeID node, NodeID source) const
+	{
+		vector<NodeID> stack(1, node);
+		vector<bool> visited(nodes.size(), false);
+
+		while (!stack.empty())
+		{
+			NodeID n = stack.back();
+			stack.pop_back();
+
+			if (n == source) return true;
+			if (visited[n]) continue;
+			visited[n] = true;
+
+			map<string, Edge>::const_iterator it = nodes[n].inputs.begin();
+			while (it != nodes[n].inputs.end())
+			{
+				if (it->second.source >= 0) stack.push_back(it->second.source);
+				it++;
+			}
+		}
+
+		return false;
+	}
+
+	void update_schedule()
+	{
+		OFX_ISF_TRACE_SCOPE("Graph::update_schedule");
+
+		schedule.clear();
+		num_consumers.assign(nodes.size(), 0);
+
+		// nodes the outputs depend on
+		vector<bool> live(nodes.size(), false);
+		vector<NodeID> stack(outputs);
+		while (!stack.empty())
+		{
+			NodeID n = stack.back();
+			stack.pop_back();
+
+			if (live[n]) continue;
+			live[n] = true;
+
+			map<string, Edge>::const_iterator it = nodes[n].inputs.begin();
+			while (it != nodes[n].inputs.end())
+			{
+				if (it->second.source >= 0) stack.push_back(it->second.source);
+				it++;
+			}
+		}
+
+		// Kahn's algorithm over the live nodes, one count per input edge
+		vector<int> num_pending(nodes.size(), 0);
+		vector<vector<NodeID> > consumers(nodes.size());
+
+		for (int n = 0; n < nodes.size(); n++)
+		{
+			if (!live[n]) continue;
+
+			map<string, Edge>::const_iterator it = nodes[n].inputs.begin();
+			while (it != nodes[n].inputs.end())
+			{
+				NodeID source = it->second.source;
+				if (source >= 0)
+				{
+					num_pending[n]++;
+					num_consumers[source]++;
+					consumers[source].push_back(n);
+				}
+				it++;
+			}
+		}
+
+		deque<NodeID> ready;
+		for (int n = 0; n < nodes.size(); n++)
+			if (live[n] && num_pending[n] == 0) ready.push_back(n);
+
+		while (!ready.empty())
+		{
+			NodeID n = ready.front();
+			ready.pop_front();
+			schedule.push_back(n);
+
+			for (int i = 0; i < consumers[n].size(); i++)
+			{
+				NodeID c = consumers[n][i];
+				if (--num_pending[c] == 0) ready.push_back(c);
+			}
+		}
+
+		// outputs stay acquired until the next update()
+		for (int i = 0; i < outputs.size(); i++)
+			num_consumers[outputs[i]]++;
+
+		// culled nodes don't hold on to anything
+		for (int n = 0; n < nodes.size(); n++)
+			if (!live[n]) nodes[n].shader->releaseResult();
+
+		schedule_dirty = false;
+	}
+
+private:
+
+	Graph(const Graph&);
+	Graph& operator=(const Graph&);
+};
+
+OFX_ISF_END_NAMESPACE
@@ -0,0 +1,206 @@
+#pragma once
+
+// Window without a display for offline rendering, e.g. on Mesa llvmpipe.
+// Not part of ofxISF.h, include it from main.cpp and link EGL (-lEGL) or,
+// with OFX_ISF_HEADLESS_OSMESA defined, OSMesa (-lOSMesa, GLEW built with
+// GLEW_OSMESA).
+//
+//   ofxISF::HeadlessWindow window;
+//   ofSetupOpenGL(&window, 1920, 1080, OF_WINDOW);
+//   ofRunApp(new ofApp);
+//
+// There is no default framebuffer to draw into, render to fbos and read
+// them back. ofSetupOpenGL runs glewInit() once the context is current.
+
+#include "ofMain.h"
+
+#ifdef OFX_ISF_HEADLESS_OSMESA
+#include <GL/osmesa.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "Constants.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+OFX_ISF_BEGIN_NAMESPACE
+
+class HeadlessWindow : public ofAppBaseWindow
+{
+public:
+
+	HeadlessWindow()
+		:width(0)
+		,height(0)
+		,frame_num(0)
+#ifdef OFX_ISF_HEADLESS_OSMESA
+		,context(NULL)
+#else
+		,display(EGL_NO_DISPLAY)
+		,context(EGL_NO_CONTEXT)
+#endif
+	{}
+
+	~HeadlessWindow() { destroy_context(); }
+
+	void setupOpenGL(int w, int h, int screenMode)
+	{
+		width = w;
+		height = h;
+
+		if (!create_context())
+		{
+			ofLogFatalError("ofxISF::HeadlessWindow") << "can't create a GL context";
+			std::exit(1);
+		}
+
+		ofLogNotice("ofxISF::HeadlessWindow") << (const char*)glGetString(GL_RENDERER) << ", " << (const char*)glGetString(GL_VERSION);
+	}
+
+	// setup() once, then update() and draw() as fast as possible until
+	// the app calls ofExit()
+	void runAppViaInfiniteLoop(ofBaseApp *app)
+	{
+		ofNotifySetup();
+
+		while (true)
+		{
+			ofNotifyUpdate();
+			ofNotifyDraw();
+			frame_num++;
+		}
+	}
+
+	ofPoint getWindowSize() { return ofPoint(width, height); }
+	ofPoint getScreenSize() { return ofPoint(width, height); }
+	ofPoint getWindowPosition() { return ofPoint(); }
+
+	int getWidth() { return width; }
+	int getHeight() { return height; }
+
+	int getWindowMode() { return OF_WINDOW; }
+
+	int getFrameNum() { return frame_num; }
+	float getFrameRate() { return 0; }
+	double getLastFrameTime() { return 0; }
+
+protected:
+
+	int width, height;
+	int frame_num;
+
+#ifdef OFX_ISF_HEADLESS_OSMESA
+
+	OSMesaContext context;
+	vector<unsigned char> buffer;
+
+	bool create_context()
+	{
+		context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+		if (!context) return false;
+
+		// only backs the unused default framebuffer
+		buffer.resize(max(width, 1) * max(height, 1) * 4);
+		return OSMesaMakeCurrent(context, &buffer[0], GL_UNSIGNED_BYTE, max(width, 1), max(height, 1));
+	}
+
+	void destroy_context()
+	{
+		if (context) OSMesaDestroyContext(context);
+		context = NULL;
+	}
+
+#else
+
+	EGLDisplay display;
+	EGLContext context;
+
+	bool create_context()
+	{
+		// surfaceless platform first, works without any window system
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display)
+			display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		EGLint major = 0, minor = 0;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		{
+			ofLogError("ofxISF::HeadlessWindow") << "eglInitialize failed";
+			return false;
+		}
+
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			ofLogError("ofxISF::HeadlessWindow") << "no desktop GL support";
+			return false;
+		}
+
+		const EGLint config_attribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_ALPHA_SIZE, 8,
+			EGL_NONE
+		};
+
+		// without a matching config, EGL_KHR_no_config_context takes NULL
+		EGLConfig config = NULL;
+		EGLint num_configs = 0;
+		eglChooseConfig(display, config_attribs, &config, 1, &num_configs);
+		if (num_configs == 0) config = NULL;
+
+		// a core context for the programmable renderer, compatibility otherwise
+		const EGLint core_attribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+			EGL_CONTEXT_MINOR_VERSION_KHR, 2,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+			EGL_NONE
+		};
+
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, ofIsGLProgrammableRenderer() ? core_attribs : NULL);
+		if (context == EGL_NO_CONTEXT)
+		{
+			ofLogError("ofxISF::HeadlessWindow") << "eglCreateContext failed: 0x" << hex << eglGetError();
+			return false;
+		}
+
+		// EGL_KHR_surfaceless_context, everything renders into fbos
+		if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			ofLogError("ofxISF::HeadlessWindow") << "eglMakeCurrent failed: 0x" << hex << eglGetError();
+			return false;
+		}
+
+		return true;
+	}
+
+	void destroy_context()
+	{
+		if (display == EGL_NO_DISPLAY) return;
+
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+		eglTerminate(display);
+
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+	}
+
+#endif
+
+private:
+
+	HeadlessWindow(const HeadlessWindow&);
+	HeadlessWindow& operator=(const HeadlessWindow&);
+};
+
+OFX_ISF_END_NAMESPACE
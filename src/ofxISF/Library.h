@@ -0,0 +1,286 @@
+#pragma once
+
+#include "Poco/Condition.h"
+
+#include "Shader.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Loads a directory of ISF files. File reads, header parsing and code
+// generation run on worker threads, only the GL compile/link happens in
+// update() on the GL thread.
+
+class Library
+{
+public:
+
+	struct Progress
+	{
+		string path;
+		bool succeeded;
+		size_t loaded, failed, total;
+	};
+
+	ofEvent<Progress> progressEvent;
+
+	Library()
+		:width(0)
+		,height(0)
+		,internalformat(GL_RGB)
+		,queue_size(8)
+		,num_total(0)
+		,num_loaded(0)
+		,num_failed(0)
+		,num_pending(0)
+		,running(false)
+	{}
+
+	~Library()
+	{
+		stop();
+
+		for (int i = 0; i < shaders.size(); i++)
+			delete shaders[i];
+
+		shaders.clear();
+		shader_map.clear();
+	}
+
+	void setup(int width, int height, int internalformat = GL_RGB, int num_threads = 4, size_t queue_size = 8)
+	{
+		stop();
+
+		this->width = width;
+		this->height = height;
+		this->internalformat = internalformat;
+		this->queue_size = max<size_t>(queue_size, 1);
+
+		running = true;
+
+		num_threads = max(num_threads, 1);
+		for (int i = 0; i < num_threads; i++)
+		{
+			Worker *o = new Worker(this);
+			workers.push_back(o);
+			o->startThread(true, false);
+		}
+	}
+
+	void load(const string& path, const string& ext = "fs")
+	{
+		ofDirectory dir;
+		dir.allowExt(ext);
+		dir.listDir(path);
+		dir.sort();
+
+		ofMutex::ScopedLock lock(mutex);
+
+		for (int i = 0; i < dir.size(); i++)
+		{
+			jobs.push_back(dir.getPath(i));
+			num_total++;
+			num_pending++;
+		}
+
+		job_cond.broadcast();
+	}
+
+	// call every frame from the GL thread, compiles loaded bundles until
+	// the time budget is used up (at least one per call)
+	void update(float time_budget_ms = 4)
+	{
+		OFX_ISF_TRACE_SCOPE("Library::update");
+
+		unsigned long long start = ofGetElapsedTimeMicros();
+
+		while (true)
+		{
+			Result result;
+
+			{
+				ofMutex::ScopedLock lock(mutex);
+				if (results.empty()) break;
+
+				result = results.front();
+				results.pop_front();
+				num_pending--;
+
+				result_cond.signal();
+			}
+
+			bool succeeded = result.succeeded;
+
+			if (succeeded)
+			{
+				Shader *shader = new Shader;
+				shader->setup(width, height, internalformat);
+
+				if (shader->load(result.bundle))
+				{
+					shaders.push_back(shader);
+					shader_map[shader->getName()] = shader;
+				}
+				else
+				{
+					delete shader;
+					succeeded = false;
+				}
+			}
+
+			if (succeeded) num_loaded++;
+			else num_failed++;
+
+			Progress progress;
+			progress.path = result.path;
+			progress.succeeded = succeeded;
+			progress.loaded = num_loaded;
+			progress.failed = num_failed;
+			progress.total = num_total;
+			ofNotifyEvent(progressEvent, progress, this);
+
+			if ((ofGetElapsedTimeMicros() - start) > time_budget_ms * 1000) break;
+		}
+	}
+
+	bool isLoading() const
+	{
+		ofMutex::ScopedLock lock(mutex);
+		return num_pending > 0;
+	}
+
+	//
+
+	inline size_t size() const { return shaders.size(); }
+	inline bool hasShader(const string& name) const { return shader_map.find(name) != shader_map.end(); }
+
+	Shader* getShader(size_t index) const { return shaders[index]; }
+	Shader* getShader(const string& name) const
+	{
+		if (!hasShader(name)) return NULL;
+		return shader_map[name];
+	}
+
+protected:
+
+	struct Result
+	{
+		string path;
+		bool succeeded;
+		Bundle bundle;
+	};
+
+	class Worker : public ofThread
+	{
+	public:
+
+		Worker(Library *library) : library(library) {}
+
+	protected:
+
+		Library *library;
+
+		void threadedFunction()
+		{
+			// naming allocates the thread's trace ring, only pay for it when tracing
+			if (Trace::isEnabled()) Trace::setThreadName("ofxISF::Library worker");
+
+			string path;
+			while (library->pop_job(path))
+			{
+				Result result;
+				result.path = path;
+
+				{
+					OFX_ISF_TRACE_SCOPE("Library::prepare");
+					result.succeeded = prepare(path, result.bundle);
+				}
+
+				if (!library->push_result(result)) break;
+			}
+		}
+	};
+
+	int width, height;
+	int internalformat;
+	size_t queue_size;
+
+	vector<Worker*> workers;
+
+	mutable ofMutex mutex;
+	Poco::Condition job_cond;
+	Poco::Condition result_cond;
+
+	deque<string> jobs;
+	deque<Result> results;
+
+	size_t num_total, num_loaded, num_failed, num_pending;
+	bool running;
+
+	vector<Shader*> shaders;
+	mutable map<string, Shader*> shader_map;
+
+	void stop()
+	{
+		{
+			ofMutex::ScopedLock lock(mutex);
+			running = false;
+
+			// jobs in flight are counted off by push_result()
+			num_pending -= jobs.size() + results.size();
+			jobs.clear();
+			results.clear();
+
+			job_cond.broadcast();
+			result_cond.broadcast();
+		}
+
+		for (int i = 0; i < workers.size(); i++)
+		{
+			workers[i]->waitForThread(false);
+			delete workers[i];
+		}
+
+		workers.clear();
+	}
+
+	bool pop_job(string& path)
+	{
+		ofMutex::ScopedLock lock(mutex);
+
+		while (running && jobs.empty())
+			job_cond.wait(mutex);
+
+		if (!running) return false;
+
+		path = jobs.front();
+		jobs.pop_front();
+		return true;
+	}
+
+	// blocks while the result queue is full
+	bool push_result(const Result& result)
+	{
+		ofMutex::ScopedLock lock(mutex);
+
+		while (running && results.size() >= queue_size)
+			result_cond.wait(mutex);
+
+		if (!running)
+		{
+			num_pending--;
+			return false;
+		}
+
+		results.push_back(result);
+		return true;
+	}
+
+	// everything up to GL compile, safe to run off the GL thread
+	static bool prepare(const string& path, Bundle& bundle)
+	{
+		if (!BundleCache::load(path, bundle)) return false;
+		return Shader::prepareBundle(bundle);
+	}
+};
+
+OFX_ISF_END_NAMESPACE
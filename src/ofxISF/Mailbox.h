@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Constants.h"
+#include "Uniforms.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+template <typename T>
+struct MailboxValue;
+
+template <>
+struct MailboxValue<bool>
+{
+	static void pack(const bool& v, float *d) { d[0] = v ? 1 : 0; }
+	static bool unpack(const float *d) { return d[0] != 0; }
+};
+
+template <>
+struct MailboxValue<float>
+{
+	static void pack(const float& v, float *d) { d[0] = v; }
+	static float unpack(const float *d) { return d[0]; }
+};
+
+template <>
+struct MailboxValue<ofFloatColor>
+{
+	static void pack(const ofFloatColor& v, float *d) { d[0] = v.r; d[1] = v.g; d[2] = v.b; d[3] = v.a; }
+	static ofFloatColor unpack(const float *d) { return ofFloatColor(d[0], d[1], d[2], d[3]); }
+};
+
+template <>
+struct MailboxValue<ofVec2f>
+{
+	static void pack(const ofVec2f& v, float *d) { d[0] = v.x; d[1] = v.y; }
+	static ofVec2f unpack(const float *d) { return ofVec2f(d[0], d[1]); }
+};
+
+// Single producer / single consumer mailbox of uniform writes. One
+// control thread posts, the GL thread drains at the start of
+// Shader::update() (or Chain::update()). Use one mailbox per producer
+// thread.
+//
+// Every uniform posted to gets its own slot holding the latest value, a
+// post overwrites it, so a burst of writes to the same uniform collapses
+// into one update and the newest value always wins. A sequence number
+// per slot tells drain() which slots changed and detects reads torn by a
+// concurrent post, those are picked up by the next drain(). Only the
+// first post to a uniform allocates.
+
+class ParameterMailbox
+{
+public:
+
+	// capacity is the number of distinct uniforms
+	ParameterMailbox(size_t capacity = 1024) : slots(max<size_t>(capacity, 1)), num_slots(0) {}
+
+	// producer thread only, returns false for an invalid handle or if all
+	// slots are taken by other uniforms
+	template <typename T, typename TT>
+	bool post(const UniformHandle<T>& handle, const TT& value)
+	{
+		if (!handle.isValid()) return false;
+
+		Slot *s = find_slot(handle.ref, &apply<T>);
+		if (s == NULL) return false;
+
+		float data[4] = { 0, 0, 0, 0 };
+		MailboxValue<T>::pack(T(value), data);
+
+		// odd while the value is being written
+		unsigned int seq = s->sequence;
+		store_release(s->sequence, seq + 1);
+		for (int i = 0; i < 4; i++) s->data[i] = data[i];
+		store_release(s->sequence, seq + 2);
+
+		return true;
+	}
+
+	// consumer (GL) thread only, returns the number of uniforms updated
+	size_t drain()
+	{
+		size_t num = 0;
+		size_t n = load_acquire(num_slots);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			Slot &s = slots[i];
+
+			unsigned int seq = load_acquire(s.sequence);
+			if (seq == s.applied || (seq & 1)) continue;
+
+			float data[4];
+			for (int k = 0; k < 4; k++) data[k] = s.data[k];
+
+			// overwritten meanwhile, the next drain() gets the newer value
+			if (load_acquire(s.sequence) != seq) continue;
+
+			s.apply(s.target.get(), data);
+			s.applied = seq;
+			num++;
+		}
+
+		return num;
+	}
+
+	bool empty() const
+	{
+		size_t n = load_acquire(num_slots);
+		for (size_t i = 0; i < n; i++)
+			if (load_acquire(slots[i].sequence) != slots[i].applied) return false;
+		return true;
+	}
+
+protected:
+
+	struct Slot
+	{
+		// set once before the slot is published
+		Uniform::Ref target;
+		void (*apply)(Uniform*, const float*);
+
+		volatile unsigned int sequence;
+		volatile float data[4];
+
+		// consumer thread
+		unsigned int applied;
+
+		Slot() : apply(NULL), sequence(0), applied(0) {}
+	};
+
+	vector<Slot> slots;
+	volatile size_t num_slots;
+
+	// producer thread
+	map<Uniform*, size_t> slot_index;
+
+	Slot* find_slot(const Uniform::Ref& target, void (*apply)(Uniform*, const float*))
+	{
+		map<Uniform*, size_t>::iterator it = slot_index.find(target.get());
+		if (it != slot_index.end()) return &slots[it->second];
+
+		size_t n = num_slots;
+		if (n == slots.size()) return NULL;
+
+		Slot &s = slots[n];
+		s.target = target;
+		s.apply = apply;
+
+		slot_index[target.get()] = n;
+		store_release(num_slots, n + 1);
+
+		return &s;
+	}
+
+	template <typename T>
+	static void apply(Uniform *uniform, const float *data)
+	{
+		static_cast<Uniform_<T>*>(uniform)->set(MailboxValue<T>::unpack(data));
+	}
+
+private:
+
+	ParameterMailbox(const ParameterMailbox&);
+	ParameterMailbox& operator=(const ParameterMailbox&);
+};
+
+OFX_ISF_END_NAMESPACE
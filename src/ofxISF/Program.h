@@ -0,0 +1,545 @@
+#pragma once
+
+#include "Constants.h"
+#include "Trace.h"
+#include "Bundle.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+class ProgramBinaryCache
+{
+public:
+
+	struct Stats
+	{
+		unsigned int hits;
+		unsigned int misses;
+		unsigned int rejected;
+
+		Stats() : hits(0), misses(0), rejected(0) {}
+	};
+
+	// empty path disables the cache (default)
+	static void setDirectory(const string& path)
+	{
+		getDirectoryRef() = path;
+		if (!path.empty()) ofDirectory::createDirectory(path, true, true);
+	}
+
+	static const string& getDirectory() { return getDirectoryRef(); }
+
+	static bool isEnabled() { return !getDirectoryRef().empty() && isSupported(); }
+
+	static bool isSupported()
+	{
+		static int supported = -1;
+		if (supported < 0)
+		{
+			GLint num_formats = 0;
+			if (GLEW_ARB_get_program_binary)
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+			supported = num_formats > 0;
+		}
+		return supported;
+	}
+
+	static const Stats& getStats() { return getStatsRef(); }
+	static void resetStats() { getStatsRef() = Stats(); }
+
+	static unsigned long long getKey(const string& vert, const string& frag)
+	{
+		static string driver;
+		if (driver.empty())
+		{
+			driver += (const char*)glGetString(GL_VENDOR);
+			driver += "\n";
+			driver += (const char*)glGetString(GL_RENDERER);
+			driver += "\n";
+			driver += (const char*)glGetString(GL_VERSION);
+		}
+
+		unsigned long long h = hash_string(driver);
+		h = hash_string(vert, h);
+		h = hash_string(frag, h);
+		return h;
+	}
+
+	// returns true if the program was linked from the cached binary
+	static bool load(GLuint program, unsigned long long key)
+	{
+		OFX_ISF_TRACE_SCOPE("ProgramBinaryCache::load");
+
+		if (!isEnabled()) return false;
+
+		ifstream is(getCachePath(key).c_str(), ios::binary);
+
+		GLenum format = 0;
+		string data;
+
+		BinaryReader r(is);
+		unsigned int magic = 0, version = 0;
+		if (!is
+			|| !r.read(magic) || magic != MAGIC
+			|| !r.read(version) || version != VERSION
+			|| !r.read(format)
+			|| !r.read(data))
+		{
+			getStatsRef().misses++;
+			ofLogVerbose("ofxISF::ProgramBinaryCache") << "miss: " << hash_to_string(key);
+			return false;
+		}
+
+		glProgramBinary(program, format, data.data(), data.size());
+
+		GLint status = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			// driver update or different GPU
+			getStatsRef().rejected++;
+			ofLogVerbose("ofxISF::ProgramBinaryCache") << "rejected: " << hash_to_string(key);
+			return false;
+		}
+
+		getStatsRef().hits++;
+		ofLogVerbose("ofxISF::ProgramBinaryCache") << "hit: " << hash_to_string(key);
+		return true;
+	}
+
+	static void store(GLuint program, unsigned long long key)
+	{
+		if (!isEnabled()) return;
+
+		GLint size = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+		if (size <= 0) return;
+
+		string data;
+		data.resize(size);
+
+		GLenum format = 0;
+		GLsizei length = 0;
+		glGetProgramBinary(program, size, &length, &format, &data[0]);
+		if (length <= 0) return;
+		data.resize(length);
+
+		string cache_path = getCachePath(key);
+		string tmp_path = cache_path + ".tmp";
+
+		{
+			ofstream os(tmp_path.c_str(), ios::binary | ios::trunc);
+			if (!os) return;
+
+			BinaryWriter w(os);
+			w.write((unsigned int)MAGIC);
+			w.write((unsigned int)VERSION);
+			w.write((unsigned int)format);
+			w.write(data);
+			if (!w.good()) return;
+		}
+
+		try
+		{
+			Poco::File(tmp_path).renameTo(cache_path);
+		}
+		catch (...)
+		{
+			ofLogWarning("ofxISF::ProgramBinaryCache") << "couldn't write cache: " << cache_path;
+		}
+	}
+
+protected:
+
+	enum {
+		MAGIC = 0x50465349, // "ISFP"
+		VERSION = 1
+	};
+
+	static string& getDirectoryRef()
+	{
+		static string dir;
+		return dir;
+	}
+
+	static Stats& getStatsRef()
+	{
+		static Stats stats;
+		return stats;
+	}
+
+	static string getCachePath(unsigned long long key)
+	{
+		return ofFilePath::join(ofToDataPath(getDirectory(), true), hash_to_string(key) + ".bin");
+	}
+};
+
+//
+
+struct UniformLocation
+{
+	GLint location;
+	GLint extra_location;
+
+	// chroma planes and conversion matrix of a YUV ImageUniform
+	GLint plane_location[2];
+	GLint plane_pct_location;
+	GLint yuv_matrix_location;
+
+	// generation of the value last uploaded to this program
+	unsigned int generation;
+	bool uploaded;
+
+	UniformLocation() : location(-1), extra_location(-1), plane_pct_location(-1), yuv_matrix_location(-1), generation(0), uploaded(false)
+	{
+		plane_location[0] = plane_location[1] = -1;
+	}
+};
+
+struct UploadStats
+{
+	unsigned int uploaded;
+	unsigned int skipped;
+
+	UploadStats() : uploaded(0), skipped(0) {}
+};
+
+class Program
+{
+public:
+
+	typedef Ref_<Program> Ref;
+
+	enum {
+		INPUT_BLOCK_BINDING = 0,
+		POSITION_ATTRIBUTE = 0
+	};
+
+	enum Builtin
+	{
+		PASSINDEX,
+		RENDERSIZE,
+		TIME,
+		NUM_BUILTINS
+	};
+
+	Program() : program(0), previous_program(0) {}
+	~Program() { unload(); }
+
+	bool load(const string& vert, const string& frag)
+	{
+		OFX_ISF_TRACE_SCOPE("Program::load");
+
+		unload();
+
+		program = glCreateProgram();
+
+		unsigned long long key = 0;
+		if (ProgramBinaryCache::isEnabled())
+		{
+			key = ProgramBinaryCache::getKey(vert, frag);
+			if (ProgramBinaryCache::load(program, key))
+			{
+				resolve_builtins();
+				return true;
+			}
+			
+			glDeleteProgram(program);
+			program = glCreateProgram();
+		}
+
+		GLuint vs = compile(GL_VERTEX_SHADER, vert);
+		if (vs == 0)
+		{
+			unload();
+			return false;
+		}
+
+		GLuint fs = compile(GL_FRAGMENT_SHADER, frag);
+		if (fs == 0)
+		{
+			glDeleteShader(vs);
+			unload();
+			return false;
+		}
+
+		glAttachShader(program, vs);
+		glAttachShader(program, fs);
+
+		if (ProgramBinaryCache::isEnabled())
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+		// used by the core profile vertex shader, see FullscreenTriangle
+		glBindAttribLocation(program, POSITION_ATTRIBUTE, "position");
+
+		GLint status = GL_FALSE;
+
+		{
+			// the status query waits for drivers that link in the background
+			OFX_ISF_TRACE_SCOPE("Program::link");
+			glLinkProgram(program);
+			glGetProgramiv(program, GL_LINK_STATUS, &status);
+		}
+
+		// flagged for deletion, freed with the program
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+
+		if (status != GL_TRUE)
+		{
+			ofLogError("ofxISF::Program") << "link failed: " << getInfoLog(program, false);
+			unload();
+			return false;
+		}
+
+		if (ProgramBinaryCache::isEnabled())
+			ProgramBinaryCache::store(program, key);
+
+		resolve_builtins();
+		return true;
+	}
+
+	// programs with the same source can be shared when all per-instance
+	// state lives in a uniform block
+	static Ref getShared(const string& vert, const string& frag)
+	{
+		typedef map<unsigned long long, Ref> SharedMap;
+		static SharedMap shared;
+
+		// drop the ones nobody uses anymore
+		SharedMap::iterator it = shared.begin();
+		while (it != shared.end())
+		{
+			if (it->second.use_count() == 1) shared.erase(it++);
+			else it++;
+		}
+
+		unsigned long long key = hash_string(frag, hash_string(vert));
+
+		Ref &o = shared[key];
+		if (!o) o = Ref(new Program);
+		return o;
+	}
+
+	void unload()
+	{
+		if (program == 0) return;
+
+		glDeleteProgram(program);
+		program = 0;
+
+		uniform_locations.clear();
+	}
+
+	bool isLoaded() const { return program != 0; }
+
+	GLuint getProgram() const { return program; }
+
+	// restores the previous program, renderers that cache the bound
+	// program (e.g. ofGLProgrammableRenderer) stay in sync
+	void begin()
+	{
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+		glUseProgram(program);
+	}
+
+	void end()
+	{
+		glUseProgram(previous_program);
+		previous_program = 0;
+	}
+
+	//
+
+	GLint getBuiltinLocation(Builtin v) const { return builtin_locations[v]; }
+
+	// returns false if the program already holds this value
+	bool updateBuiltin(Builtin v, float x, float y = 0)
+	{
+		if (builtin_uploaded[v]
+			&& builtin_values[v][0] == x
+			&& builtin_values[v][1] == y) return false;
+
+		builtin_uploaded[v] = true;
+		builtin_values[v][0] = x;
+		builtin_values[v][1] = y;
+		return true;
+	}
+
+	// resolved once after link, indexed like the Uniforms the program was generated from
+	vector<UniformLocation>& getUniformLocations() { return uniform_locations; }
+	const vector<UniformLocation>& getUniformLocations() const { return uniform_locations; }
+
+	//
+
+	GLint getUniformLocation(const string& name) const
+	{
+		return glGetUniformLocation(program, name.c_str());
+	}
+
+	void setUniform1i(const string& name, int v)
+	{
+		glUniform1i(getUniformLocation(name), v);
+	}
+
+	void setUniform1f(const string& name, float v)
+	{
+		glUniform1f(getUniformLocation(name), v);
+	}
+
+	void setUniform2fv(const string& name, const float *v)
+	{
+		glUniform2fv(getUniformLocation(name), 1, v);
+	}
+
+	void setUniform4fv(const string& name, const float *v)
+	{
+		glUniform4fv(getUniformLocation(name), 1, v);
+	}
+
+	void setUniformTexture(const string& name, ofTexture& tex, int texture_unit)
+	{
+		const ofTextureData &data = tex.getTextureData();
+
+		glActiveTexture(GL_TEXTURE0 + texture_unit);
+		glBindTexture(data.textureTarget, data.textureID);
+		setUniform1i(name, texture_unit);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+protected:
+
+	GLuint program;
+	GLint previous_program;
+
+	GLint builtin_locations[NUM_BUILTINS];
+	float builtin_values[NUM_BUILTINS][2];
+	bool builtin_uploaded[NUM_BUILTINS];
+	vector<UniformLocation> uniform_locations;
+
+	void resolve_builtins()
+	{
+		if (GLEW_ARB_uniform_buffer_object)
+		{
+			GLuint index = glGetUniformBlockIndex(program, "ISFInputs");
+			if (index != GL_INVALID_INDEX)
+				glUniformBlockBinding(program, index, INPUT_BLOCK_BINDING);
+		}
+		
+		for (int i = 0; i < NUM_BUILTINS; i++)
+			builtin_uploaded[i] = false;
+		
+		builtin_locations[PASSINDEX] = glGetUniformLocation(program, "PASSINDEX");
+		builtin_locations[RENDERSIZE] = glGetUniformLocation(program, "RENDERSIZE");
+		builtin_locations[TIME] = glGetUniformLocation(program, "TIME");
+	}
+
+	GLuint compile(GLenum type, const string& source)
+	{
+		OFX_ISF_TRACE_SCOPE("Program::compile");
+
+		GLuint shader = glCreateShader(type);
+
+		const char *src = source.c_str();
+		glShaderSource(shader, 1, &src, NULL);
+		glCompileShader(shader);
+
+		GLint status = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			ofLogError("ofxISF::Program") << "compile failed: " << getInfoLog(shader, true);
+			ofLogVerbose("ofxISF::Program") << source;
+
+			glDeleteShader(shader);
+			return 0;
+		}
+
+		return shader;
+	}
+
+	static string getInfoLog(GLuint object, bool is_shader)
+	{
+		GLint length = 0;
+		if (is_shader) glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+		else glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+
+		if (length <= 1) return "";
+
+		string log;
+		log.resize(length);
+		if (is_shader) glGetShaderInfoLog(object, length, NULL, &log[0]);
+		else glGetProgramInfoLog(object, length, NULL, &log[0]);
+
+		return log;
+	}
+
+private:
+
+	Program(const Program&);
+	Program& operator=(const Program&);
+};
+
+// One triangle covering the viewport, in normalized [0, 2] coordinates so
+// the visible part maps to [0, 1]. Created once and shared by all Shaders,
+// needs a context with vertex array objects (GL 3.0 or ARB_vertex_array_object).
+
+class FullscreenTriangle
+{
+public:
+
+	static bool isSupported()
+	{
+		return GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+	}
+
+	static void draw()
+	{
+		GLuint vao = getVertexArray();
+		if (vao == 0) return;
+
+		GLint previous_vao = 0;
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+
+		glBindVertexArray(vao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(previous_vao);
+	}
+
+protected:
+
+	static GLuint getVertexArray()
+	{
+		static GLuint vao = 0;
+		static GLuint vbo = 0;
+
+		if (vao == 0 && isSupported())
+		{
+			const GLfloat vertices[] = {
+				0, 0,
+				2, 0,
+				0, 2
+			};
+
+			GLint previous_vao = 0, previous_buffer = 0;
+			glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+			glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previous_buffer);
+
+			glGenVertexArrays(1, &vao);
+			glBindVertexArray(vao);
+
+			glGenBuffers(1, &vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+			glEnableVertexAttribArray(Program::POSITION_ATTRIBUTE);
+			glVertexAttribPointer(Program::POSITION_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+			glBindVertexArray(previous_vao);
+			glBindBuffer(GL_ARRAY_BUFFER, previous_buffer);
+		}
+
+		return vao;
+	}
+};
+
+OFX_ISF_END_NAMESPACE
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Constants.h"
+#include "Trace.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Recycles fbos by (width, height, internalformat). Shaders using a pool
+// acquire their output and transient pass targets every frame and give
+// them back once nobody reads them anymore, so a Chain only keeps the
+// intermediates that are actually live. Contents of an acquired target
+// are undefined. GL thread only.
+
+class RenderTargetPool
+{
+public:
+
+	typedef Ref_<RenderTargetPool> Ref;
+
+	RenderTargetPool() : num_in_use(0) {}
+
+	~RenderTargetPool()
+	{
+		map<ofFbo*, Key>::iterator it = keys.begin();
+		while (it != keys.end())
+		{
+			delete it->first;
+			it++;
+		}
+
+		keys.clear();
+		free_targets.clear();
+	}
+
+	ofFbo* acquire(int width, int height, int internalformat)
+	{
+		Key key(width, height, internalformat);
+
+		ofFbo *fbo = NULL;
+
+		vector<ofFbo*> &targets = free_targets[key];
+		if (!targets.empty())
+		{
+			fbo = targets.back();
+			targets.pop_back();
+		}
+		else
+		{
+			OFX_ISF_TRACE_SCOPE("RenderTargetPool::allocate");
+			fbo = new ofFbo;
+			fbo->allocate(width, height, internalformat);
+			keys[fbo] = key;
+		}
+
+		num_in_use++;
+		return fbo;
+	}
+
+	void release(ofFbo *fbo)
+	{
+		if (fbo == NULL) return;
+
+		map<ofFbo*, Key>::iterator it = keys.find(fbo);
+		if (it == keys.end())
+		{
+			ofLogError("ofxISF::RenderTargetPool") << "not acquired from this pool";
+			return;
+		}
+
+		free_targets[it->second].push_back(fbo);
+		num_in_use--;
+	}
+
+	// frees the targets nobody holds right now
+	void purge()
+	{
+		map<Key, vector<ofFbo*> >::iterator it = free_targets.begin();
+		while (it != free_targets.end())
+		{
+			vector<ofFbo*> &targets = it->second;
+			for (int i = 0; i < targets.size(); i++)
+			{
+				keys.erase(targets[i]);
+				delete targets[i];
+			}
+			it++;
+		}
+
+		free_targets.clear();
+	}
+
+	size_t getNumAllocated() const { return keys.size(); }
+	size_t getNumInUse() const { return num_in_use; }
+
+protected:
+
+	struct Key
+	{
+		int width, height;
+		int internalformat;
+
+		Key() : width(0), height(0), internalformat(0) {}
+		Key(int width, int height, int internalformat) : width(width), height(height), internalformat(internalformat) {}
+
+		bool operator<(const Key& o) const
+		{
+			if (width != o.width) return width < o.width;
+			if (height != o.height) return height < o.height;
+			return internalformat < o.internalformat;
+		}
+	};
+
+	map<Key, vector<ofFbo*> > free_targets;
+	map<ofFbo*, Key> keys;
+	size_t num_in_use;
+
+private:
+
+	RenderTargetPool(const RenderTargetPool&);
+	RenderTargetPool& operator=(const RenderTargetPool&);
+};
+
+OFX_ISF_END_NAMESPACE
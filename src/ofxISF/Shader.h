@@ -1,9 +1,19 @@
 #pragma once
 
 #include "Constants.h"
+#include "Trace.h"
 #include "Uniforms.h"
+#include "CodeGenerater.h"
+#include "Bundle.h"
+#include "Mailbox.h"
+#include "Automation.h"
+#include "Expression.h"
+#include "RenderTargetPool.h"
+#include "GpuTimer.h"
+#include "Clock.h"
+#include "StreamingTexture.h"
 
-#include "jsonxx.h"
+#include <set>
 
 OFX_ISF_BEGIN_NAMESPACE
 
@@ -16,12 +26,40 @@ public:
 		,current_framebuffer(NULL)
 		,result_texture(NULL)
 		,internalformat(GL_RGB)
-	{}
+		,current_time(0)
+		,uniform_block_enabled(false)
+		,uniform_buffer(0)
+		,uniform_buffer_size(0)
+		,core_profile_enabled(get_default_core_profile())
+		,skip_unchanged(false)
+		,animated(false)
+		,rendered(false)
+		,last_update_rendered(false)
+		,output_generation(0)
+		,profiling_enabled(false)
+	{
+		code_generator.setProfile(core_profile_enabled ? CodeGenerator::PROFILE_CORE : CodeGenerator::PROFILE_COMPATIBILITY);
+	}
+	
+	~Shader()
+	{
+		release_framebuffers(false);
+		
+		if (uniform_buffer) glDeleteBuffers(1, &uniform_buffer);
+		
+		for (int i = 0; i < mailboxes.size(); i++)
+			delete mailboxes[i];
+		mailboxes.clear();
+	}
 
 	void setup(int w, int h, int internalformat = GL_RGB)
 	{
 		render_size.set(w, h);
 		this->internalformat = internalformat;
+		rendered = false;
+		
+		// pooled targets are acquired in update()
+		if (pool) return;
 		
 		ofFbo &fbo = framebuffer_map["DEFAULT"];
 		fbo.allocate(render_size.x, render_size.y, internalformat);
@@ -30,63 +68,291 @@ public:
 		ofClear(0);
 		fbo.end();
 	}
+	
+	// borrow the output and transient pass targets from a pool instead of
+	// owning them. persistent buffers stay owned by the Shader.
+	bool setRenderTargetPool(const RenderTargetPool::Ref& pool)
+	{
+		release_framebuffers(false);
+		
+		this->pool = pool;
+		
+		framebuffer_map.clear();
+		current_framebuffer = NULL;
+		
+		if (!pool) setup(render_size.x, render_size.y, internalformat);
+		
+		if (!bundle.shader_directive.empty()) return reload_shader();
+		return true;
+	}
+	
+	const RenderTargetPool::Ref& getRenderTargetPool() const { return pool; }
+	
+	// with a pool, the output stays acquired until this is called or the
+	// next update() starts. the texture contents are undefined afterwards.
+	// with setSkipUnchanged() the output of a shader that isn't animated
+	// stays acquired as the cache, transient pass targets are returned
+	// after every update() either way.
+	void releaseResult()
+	{
+		if (skip_unchanged && !animated) return;
+		
+		release_framebuffers(false);
+	}
+	
+	// opt-in: update() doesn't render again while no uniform, image or
+	// size changed and the source is not animated (TIME or persistent
+	// buffers). textures updated in place need touchImage().
+	void setSkipUnchanged(bool v) { skip_unchanged = v; }
+	bool getSkipUnchanged() const { return skip_unchanged; }
+	
+	bool isAnimated() const { return animated; }
+	
+	// contents of the bound texture changed, e.g. a video frame
+	void touchImage(const string& name)
+	{
+		Uniform::Ref o = uniforms.getUniform(name);
+		if (o && o->isTypeOf<ofTexture*>()) o->touch();
+	}
+	
+	void touchImage()
+	{
+		if (!default_image_input_name.empty()) touchImage(default_image_input_name);
+	}
+	
+	// bumped every time update() renders, consumers compare it to see
+	// whether the output changed
+	unsigned int getOutputGeneration() const { return output_generation; }
+	
+	// false if the last update() returned the cached result
+	bool wasRendered() const { return last_update_rendered; }
+	
+	// GPU time of every rendering update() and of each pass, two
+	// timestamp queries per pass and never waits for the results
+	void setProfilingEnabled(bool v)
+	{
+		profiling_enabled = v;
+		if (v) setup_timers();
+	}
+	
+	bool getProfilingEnabled() const { return profiling_enabled; }
+	
+	GpuTimer::Stats getGpuTime() const
+	{
+		if (!frame_timer) return GpuTimer::Stats();
+		return frame_timer->getStats();
+	}
+	
+	// a source without PASSES has a single pass 0
+	GpuTimer::Stats getPassGpuTime(size_t index) const
+	{
+		if (index >= pass_timers.size()) return GpuTimer::Stats();
+		return pass_timers[index]->getStats();
+	}
+	
+	void resetGpuTime()
+	{
+		if (frame_timer) frame_timer->reset();
+		for (int i = 0; i < pass_timers.size(); i++)
+			pass_timers[i]->reset();
+	}
 
 	bool load(const string& path)
 	{
-		if (!ofFile::doesFileExist(path))
-		{
-			ofLogError("ofxISF") << "no such file";
-			return false;
-		}
+		Bundle bundle;
+		if (!BundleCache::load(path, bundle)) return false;
 		
-		name = ofFilePath::getBaseName(path);
+		return load(bundle);
+	}
+	
+	bool load(const Bundle& bundle)
+	{
+		OFX_ISF_TRACE_SCOPE("Shader::load");
+		
+		this->bundle = bundle;
+		
+		name = bundle.name;
+		description = bundle.description;
+		credit = bundle.credit;
+		categories = bundle.categories;
+		
+		inputs = bundle.inputs;
+		presistent_buffers = bundle.presistent_buffers;
+		passes = bundle.passes;
+		
+		remove_unused_uniforms();
 		
-		string data = ofBufferFromFile(path).getText();
-		if (!parse_directive(data, header_directive, shader_directive)) return false;
 		if (!reload_shader()) return false;
 
 		return true;
 	}
+	
+	// generates the code a freshly loaded Shader with default settings
+	// picks, so load() finds it in the bundle. no GL calls, safe on any thread.
+	static bool prepareBundle(Bundle& bundle)
+	{
+		// inputs unbound, persistent buffers and pass targets bound to their fbos
+		Uniforms uniforms;
+		
+		for (int i = 0; i < bundle.inputs.size(); i++)
+		{
+			const Input &input = bundle.inputs[i];
+			Uniform::Ref uniform = Uniforms::createUniform(input);
+			if (uniform) uniforms.addUniform(input.name, uniform);
+		}
+		
+		for (int i = 0; i < bundle.presistent_buffers.size(); i++)
+		{
+			const string &name = bundle.presistent_buffers[i].name;
+			uniforms.addUniform(name, create_target_uniform(name));
+		}
+		
+		for (int i = 0; i < bundle.passes.size(); i++)
+		{
+			// already existing names are skipped
+			const string &name = bundle.passes[i].target;
+			if (!name.empty()) uniforms.addUniform(name, create_target_uniform(name));
+		}
+		
+		bool core_profile = get_default_core_profile();
+		
+		string signature = get_program_signature(uniforms, core_profile);
+		if (!bundle.vert.empty() && bundle.sampler_signature == signature) return true;
+		
+		CodeGenerator code_generator(uniforms);
+		code_generator.setProfile(core_profile ? CodeGenerator::PROFILE_CORE : CodeGenerator::PROFILE_COMPATIBILITY);
+		if (!code_generator.generate(bundle.shader_directive)) return false;
+		
+		bundle.sampler_signature = signature;
+		bundle.vert = code_generator.getVertexShader();
+		bundle.frag = code_generator.getFragmentShader();
+		BundleCache::store(bundle);
+		
+		return true;
+	}
 
 	void update()
 	{
+		OFX_ISF_TRACE_SCOPE("Shader::update");
+		
+		for (int i = 0; i < mailboxes.size(); i++)
+			mailboxes[i]->drain();
+		
+		// same TIME for all passes of a frame
+		current_time = clock ? clock->getTime() : ofGetElapsedTimef();
+		
+		uniforms.updateAutomation(current_time);
+		
+		map<string, StreamingImage>::iterator it = streaming_images.begin();
+		while (it != streaming_images.end())
+		{
+			StreamingImage &o = it->second;
+			o.source->update();
+			
+			if (o.generation != o.source->getGeneration())
+			{
+				touchImage(it->first);
+				o.generation = o.source->getGeneration();
+			}
+			it++;
+		}
+		
 		const vector<Ref_<ImageUniform> >& images = uniforms.getImageUniforms();
-		bool need_reload_shader = false;
+		bool need_select_program = false;
 		for (int i = 0; i < images.size(); i++)
 		{
+			// no early out, every uniform has to latch its current format
 			if (images[i]->checkTextureFormatChanged())
-			{
-				need_reload_shader = true;
-				break;
-			}
+				need_select_program = true;
+		}
+		if (need_select_program)
+		{
+			select_program();
+			rendered = false;
+		}
+		
+		if (profiling_enabled) collect_timers();
+		
+		last_update_rendered = !skip_unchanged || !rendered || animated || !has_result() || inputs_changed();
+		if (!last_update_rendered) return;
+		
+		if (profiling_enabled) frame_timer->begin();
+		
+		// last frame's output, nobody reads it anymore
+		release_framebuffers(false);
+		
+		if (uniform_block_enabled) upload_uniform_block();
+		
+		for (int i = 0; i < presistent_buffers.size(); i++)
+		{
+			PersistentTarget &target = persistent_targets[presistent_buffers[i].name];
+			if (!target.sized_by_pass) resize_persistent_target(target, update_target_size(target.size));
 		}
-		if (need_reload_shader) reload_shader();
 		
-		current_framebuffer = &framebuffer_map["DEFAULT"];
+		current_framebuffer = &acquire_framebuffer("DEFAULT", render_size);
 		current_framebuffer->begin();
 		ofClear(0);
 		current_framebuffer->end();
 		
 		if (passes.empty())
 		{
+			if (profiling_enabled) pass_timers[0]->begin();
 			render_pass(0);
+			if (profiling_enabled) pass_timers[0]->end();
+			
+			if (uniform_block_enabled) reset_block_events();
 		}
 		else
 		{
 			for (int i = 0; i < passes.size(); i++)
 			{
 				Pass &pass = passes[i];
+				PersistentTarget *persistent = NULL;
+				
 				if (!pass.target.empty())
 				{
-					current_framebuffer = &framebuffer_map[pass.target];
+					TargetSize &size = pass_sizes[i];
+					
+					map<string, PersistentTarget>::iterator it = persistent_targets.find(pass.target);
+					if (it != persistent_targets.end())
+					{
+						persistent = &it->second;
+						if (!size.empty()) resize_persistent_target(*persistent, update_target_size(size));
+						
+						// write the back buffer while the uniform reads the front one
+						current_framebuffer = &persistent->getBack();
+					}
+					else
+					{
+						current_framebuffer = &acquire_framebuffer(pass.target, size.empty() ? render_size : update_target_size(size));
+					}
 				}
 				else
 				{
-					current_framebuffer = &framebuffer_map["DEFAULT"];
+					current_framebuffer = find_framebuffer("DEFAULT");
 				}
+				if (profiling_enabled) pass_timers[i]->begin();
 				render_pass(i);
+				if (profiling_enabled) pass_timers[i]->end();
+				
+				if (persistent) swap_persistent_target(*persistent);
+				
+				// like EventUniform::update() does outside of the block,
+				// later passes see the events cleared
+				if (i == 0 && uniform_block_enabled && reset_block_events() && passes.size() > 1)
+					upload_uniform_block();
 			}
 		}
+		
+		if (profiling_enabled) frame_timer->end();
+		
+		// transient targets are only read within the frame
+		release_framebuffers(true);
+		
+		// after rendering, target swaps and event resets are part of it
+		latch_inputs();
+		rendered = true;
+		output_generation++;
 	}
 
 	void draw(float x, float y, float w, float h)
@@ -144,7 +410,7 @@ public:
 			
 			return;
 		}
-		uniforms.setUniform<ofTexture*>(default_image_input_name, img);
+		setImage(default_image_input_name, img);
 	}
 	
 	void setImage(ofTexture &img)
@@ -156,6 +422,12 @@ public:
 	{
 		setImage(&img.getTextureReference());
 	}
+	
+	void setImage(StreamingTexture &img)
+	{
+		if (default_image_input_name.empty()) return;
+		setImage(default_image_input_name, img);
+	}
 
 	//
 	
@@ -165,8 +437,39 @@ public:
 		uniforms.setUniform<INT_TYPE>(name, value);
 	}
 	
+	template <typename T>
+	UniformHandle<T> getHandle(const string& name) const
+	{
+		return uniforms.getHandle<T>(name);
+	}
+	
+	// create on the GL thread, then post handle writes from one control
+	// thread. drained at the start of update(), owned by the Shader.
+	ParameterMailbox& createMailbox(size_t capacity = 1024)
+	{
+		ParameterMailbox *o = new ParameterMailbox(capacity);
+		mailboxes.push_back(o);
+		return *o;
+	}
+	
+	// curves evaluated at TIME in update(), after the mailboxes are drained
+	Automation& getAutomation() { return uniforms.getAutomation(); }
+	
+	// source of TIME, NULL for ofGetElapsedTimef()
+	void setClock(const Clock::Ref& clock) { this->clock = clock; }
+	const Clock::Ref& getClock() const { return clock; }
+	
 	void setImage(const string& name, ofTexture *img)
 	{
+		if (!streaming_images.empty()) streaming_images.erase(name);
+		
+		if (!planar_images.empty() && planar_images.erase(name))
+		{
+			Ref_<ImageUniform> o = uniforms.getUniform(name).cast<ImageUniform>();
+			if (o) o->setPlanes(ImageUniform::PLANES_RGB, img, NULL);
+			return;
+		}
+		
 		uniforms.setUniform<ofTexture*>(name, img);
 	}
 
@@ -180,6 +483,31 @@ public:
 		setImage(name, &img.getTextureReference());
 	}
 	
+	// planar YUV straight from a decoder, sampled and converted to RGB by
+	// the generated IMG_* lookups. the first switch compiles a variant.
+	bool setImageNV12(const string& name, ofTexture *y, ofTexture *uv, ImageUniform::ColorMatrix matrix = ImageUniform::YUV_BT709, bool full_range = false)
+	{
+		return set_planar_image(name, ImageUniform::PLANES_NV12, y, uv, NULL, matrix, full_range);
+	}
+	
+	bool setImageI420(const string& name, ofTexture *y, ofTexture *u, ofTexture *v, ImageUniform::ColorMatrix matrix = ImageUniform::YUV_BT709, bool full_range = false)
+	{
+		return set_planar_image(name, ImageUniform::PLANES_I420, y, u, v, matrix, full_range);
+	}
+	
+	// update() uploads its newest frame and touches the input, see
+	// setSkipUnchanged. the StreamingTexture must outlive the binding.
+	void setImage(const string& name, StreamingTexture &img)
+	{
+		if (!hasImage(name)) return;
+		
+		setImage(name, &img.getTextureReference());
+		
+		StreamingImage &o = streaming_images[name];
+		o.source = &img;
+		o.generation = img.getGeneration();
+	}
+	
 	//
 	
 	template <typename T>
@@ -200,12 +528,57 @@ public:
 		code_generator.dumpShader();
 	}
 
+	// emit all non-image inputs as one std140 uniform block, uploaded once
+	// per frame. Shaders loading the same effect then share one program.
+	bool setUniformBlockEnabled(bool v)
+	{
+		if (v && !GLEW_ARB_uniform_buffer_object)
+		{
+			ofLogError("ofxISF::Shader") << "uniform buffer objects not supported";
+			return false;
+		}
+		
+		if (uniform_block_enabled == v) return true;
+		
+		uniform_block_enabled = v;
+		uniforms.setBlockEnabled(v);
+		
+		if (!bundle.shader_directive.empty()) return reload_shader();
+		return true;
+	}
+	
+	bool getUniformBlockEnabled() const { return uniform_block_enabled; }
+	
+	// GLSL 1.50 and a shared VAO instead of the immediate mode quad.
+	// on by default with the programmable renderer.
+	bool setCoreProfileEnabled(bool v)
+	{
+		if (v && !FullscreenTriangle::isSupported())
+		{
+			ofLogError("ofxISF::Shader") << "vertex array objects not supported";
+			return false;
+		}
+		
+		if (core_profile_enabled == v) return true;
+		
+		core_profile_enabled = v;
+		code_generator.setProfile(v ? CodeGenerator::PROFILE_CORE : CodeGenerator::PROFILE_COMPATIBILITY);
+		
+		if (!bundle.shader_directive.empty()) return reload_shader();
+		return true;
+	}
+	
+	bool getCoreProfileEnabled() const { return core_profile_enabled; }
+	
 	//
 	
 	const string& getName() const { return name; }
 	const string& getDescription() const { return description; }
 	const string& getCredit() const { return credit; }
 	const vector<string>& getCategories() const { return categories; }
+	
+	// first image input, fed by setImage(ofTexture*)
+	const string& getDefaultImageInputName() const { return default_image_input_name; }
 
 	const Uniforms& getInputs() const { return input_uniforms; }
 	
@@ -213,6 +586,10 @@ public:
 	
 	const vector<ofTexture*>& getTextures() const { return textures; }
 	
+	// uniform uploads done and skipped because the program already held the value
+	const UploadStats& getUploadStats() const { return upload_stats; }
+	void resetUploadStats() { upload_stats = UploadStats(); }
+	
 protected:
 
 	ofVec2f render_size;
@@ -235,22 +612,116 @@ protected:
 	Uniforms input_uniforms;
 	CodeGenerator code_generator;
 
-	string header_directive;
-	string shader_directive;
+	Bundle bundle;
 
+	// evaluated WIDTH/HEIGHT of a pass or buffer, only re-evaluated when
+	// the render size or one of the referenced inputs changed
+	struct TargetSize
+	{
+		Expression width, height;
+		
+		vector<string> variables;
+		vector<Uniform::Ref> sources; // empty for $WIDTH and $HEIGHT
+		vector<unsigned int> generations;
+		vector<float> values;
+		
+		ofVec2f render_size;
+		ofVec2f size;
+		bool evaluated;
+		
+		TargetSize() : evaluated(false) {}
+		
+		bool empty() const { return width.empty() && height.empty(); }
+	};
+	
+	// front is the last written one, sampled by the buffer's ImageUniform.
+	// a pass targeting the buffer renders into the back one and swaps, so
+	// the back buffer holds the frame before the previous one.
+	struct PersistentTarget
+	{
+		ofFbo fbo[2];
+		int front;
+		size_t texture_index;
+		Ref_<ImageUniform> uniform;
+		
+		TargetSize size;
+		int internalformat;
+		
+		// a pass with its own WIDTH/HEIGHT renders into it
+		bool sized_by_pass;
+		
+		PersistentTarget() : front(0), texture_index(0), internalformat(GL_RGB), sized_by_pass(false) {}
+		
+		ofFbo& getFront() { return fbo[front]; }
+		ofFbo& getBack() { return fbo[front ^ 1]; }
+	};
+	
+	// DEFAULT and transient pass targets, owned without a pool
 	map<string, ofFbo> framebuffer_map;
+	
+	// or acquired from it for the current frame
+	RenderTargetPool::Ref pool;
+	map<string, ofFbo*> pooled_targets;
+	
+	map<string, PersistentTarget> persistent_targets;
+	map<string, Ref_<ImageUniform> > transient_targets;
+	
+	// inputs fed by a StreamingTexture, with the upload last seen
+	struct StreamingImage
+	{
+		StreamingTexture *source;
+		unsigned int generation;
+		
+		StreamingImage() : source(NULL), generation(0) {}
+	};
+	map<string, StreamingImage> streaming_images;
+	
+	// inputs currently bound to YUV planes
+	set<string> planar_images;
+	vector<TargetSize> pass_sizes;
+	string result_texture_name;
 	ofFbo *current_framebuffer;
 	
 	vector<ofTexture*> textures;
 	ofTexture *result_texture;
 	
-	ofShader shader;
+	// compiled programs by sampler signature, switching between rect and
+	// 2D textures only swaps the current one
+	map<string, Program::Ref> program_variants;
+	Program::Ref shader;
+	
+	float current_time;
+	Clock::Ref clock;
+	UploadStats upload_stats;
+	
+	vector<ParameterMailbox*> mailboxes;
+	
+	bool uniform_block_enabled;
+	GLuint uniform_buffer;
+	size_t uniform_buffer_size;
+	
+	bool core_profile_enabled;
+	
+	bool skip_unchanged;
+	bool animated;
+	bool rendered;
+	bool last_update_rendered;
+	
+	// uniforms and their generations at the last render
+	vector<pair<const Uniform*, unsigned int> > rendered_inputs;
+	unsigned int output_generation;
+	
+	bool profiling_enabled;
+	GpuTimer::Ref frame_timer;
+	vector<GpuTimer::Ref> pass_timers;
 
 protected:
 	
 	void render_pass(int index)
 	{
-		if (!shader.isLoaded()) return;
+		OFX_ISF_TRACE_SCOPE("Shader::render_pass");
+		
+		if (!shader || !shader->isLoaded()) return;
 		
 		current_framebuffer->begin();
 		
@@ -258,31 +729,61 @@ protected:
 		ofEnableAlphaBlending();
 		ofSetColor(255);
 		
-		shader.begin();
-		shader.setUniform1i("PASSINDEX", index);
-		shader.setUniform2fv("RENDERSIZE", render_size.getPtr());
-		shader.setUniform1f("TIME", ofGetElapsedTimef());
+		shader->begin();
+		if (shader->updateBuiltin(Program::PASSINDEX, index))
+			glUniform1i(shader->getBuiltinLocation(Program::PASSINDEX), index);
 		
-		ImageUniform::resetTextureUnitID();
+		// size of the pass target
+		ofVec2f size(current_framebuffer->getWidth(), current_framebuffer->getHeight());
+		if (shader->updateBuiltin(Program::RENDERSIZE, size.x, size.y))
+			glUniform2fv(shader->getBuiltinLocation(Program::RENDERSIZE), 1, size.getPtr());
 		
-		for (int i = 0; i < uniforms.size(); i++)
-			uniforms.getUniform(i)->update(&shader);
+		if (shader->updateBuiltin(Program::TIME, current_time))
+			glUniform1f(shader->getBuiltinLocation(Program::TIME), current_time);
 		
-		glBegin(GL_QUADS);
-		glTexCoord2f(0, 0);
-		glVertex2f(0, 0);
+		if (uniform_block_enabled)
+			glBindBufferBase(GL_UNIFORM_BUFFER, Program::INPUT_BLOCK_BINDING, uniform_buffer);
 		
-		glTexCoord2f(1, 0);
-		glVertex2f(render_size.x, 0);
+		ImageUniform::resetTextureUnitID();
 		
-		glTexCoord2f(1, 1);
-		glVertex2f(render_size.x, render_size.y);
+		{
+			OFX_ISF_TRACE_SCOPE("Shader::upload_uniforms");
+			
+			vector<UniformLocation> &locations = shader->getUniformLocations();
+			for (int i = 0; i < uniforms.size(); i++)
+			{
+				const Uniform::Ref &o = uniforms.getUniform(i);
+				if (o->isInBlock()) continue;
+				
+				if (o->upload(locations[i]))
+					upload_stats.uploaded++;
+				else
+					upload_stats.skipped++;
+			}
+		}
 		
-		glTexCoord2f(0, 1);
-		glVertex2f(0, render_size.y);
-		glEnd();
+		if (core_profile_enabled)
+		{
+			FullscreenTriangle::draw();
+		}
+		else
+		{
+			glBegin(GL_QUADS);
+			glTexCoord2f(0, 0);
+			glVertex2f(0, 0);
+			
+			glTexCoord2f(1, 0);
+			glVertex2f(size.x, 0);
+			
+			glTexCoord2f(1, 1);
+			glVertex2f(size.x, size.y);
+			
+			glTexCoord2f(0, 1);
+			glVertex2f(0, size.y);
+			glEnd();
+		}
 		
-		shader.end();
+		shader->end();
 		
 		ofPopStyle();
 		
@@ -291,285 +792,585 @@ protected:
 
 #pragma mark -
 	
-	bool parse_directive(const string &data, string& header_directive, string& shader_directive)
-	{
-		const string header_begin = "/*";
-		const string header_end = "*/";
-
-		string::size_type begin_pos = data.find_first_of(header_begin) + header_end.size();
-		string::size_type end_pos = data.find_first_of(header_end, begin_pos);
-		string::size_type count = end_pos - begin_pos;
-
-		if (begin_pos == end_pos
-			|| begin_pos == std::string::npos
-			|| end_pos == std::string::npos)
-		{
-			ofLogError("ofxISF") << "invalid format: missing header delective";
-			return false;
-		}
-
-		header_directive = data.substr(begin_pos, count);
-
-		string::size_type shader_begin = end_pos + header_end.size();
-		shader_directive = data.substr(shader_begin);
-
-		return true;
-	}
-	
 	bool reload_shader()
 	{
-		textures.clear();
-		current_framebuffer = &framebuffer_map["DEFAULT"];
+		OFX_ISF_TRACE_SCOPE("Shader::reload_shader");
 		
-		textures.push_back(&framebuffer_map["DEFAULT"].getTextureReference());
+		setup_uniforms();
 		
-		if (!parse(header_directive)) return false;
+		{
+			// drop the buffers of a previously loaded file
+			set<string> names;
+			for (int i = 0; i < presistent_buffers.size(); i++)
+				names.insert(presistent_buffers[i].name);
+			
+			map<string, PersistentTarget>::iterator it = persistent_targets.begin();
+			while (it != persistent_targets.end())
+			{
+				if (names.find(it->first) == names.end()) persistent_targets.erase(it++);
+				else it++;
+			}
+		}
 		
 		for (int i = 0; i < presistent_buffers.size(); i++)
 		{
 			const PresistentBuffer &buf = presistent_buffers[i];
-			ofFbo &fbo = framebuffer_map[buf.name];
-			textures.push_back(&fbo.getTextureReference());
+			PersistentTarget &target = persistent_targets[buf.name];
 			
-			if (!fbo.isAllocated())
-			{
-				fbo.allocate(buf.width, buf.height, internalformat);
-				
-				fbo.begin();
-				ofClear(0);
-				fbo.end();
-			}
+			if (!setup_target_size(target.size, buf.width, buf.height)) return false;
+			target.internalformat = buf.float_precision ? GL_RGBA32F_ARB : internalformat;
+			target.sized_by_pass = false;
+			
+			const ofVec2f &size = update_target_size(target.size);
+			for (int n = 0; n < 2; n++)
+				allocate_target(target.fbo[n], size, target.internalformat);
 			
-			ImageUniform *uniform = new ImageUniform(buf.name);
-			uniform->set(&fbo.getTextureReference());
-			uniforms.addUniform(buf.name, Uniform::Ref(uniform));
+			// keeps the instance when reloading
+			uniforms.addUniform(buf.name, create_target_uniform(buf.name));
+			target.uniform = uniforms.getUniform(buf.name).cast<ImageUniform>();
+			target.uniform->set(&target.getFront().getTextureReference());
 		}
 		
+		// after the persistent targets, acquiring updates the texture refs
+		current_framebuffer = &acquire_framebuffer("DEFAULT", render_size);
+		
+		result_texture_name = "";
+		if (!passes.empty())
+			result_texture_name = passes.back().target;
+		
+		if (result_texture_name == "")
+			result_texture_name = "DEFAULT";
+		
+		// pass targets that aren't persistent, sampled by later passes
+		transient_targets.clear();
+		pass_sizes.clear();
+		pass_sizes.resize(passes.size());
+		
+		for (int i = 0; i < passes.size(); i++)
 		{
-			string result_texture_name = "";
+			const Pass &pass = passes[i];
+			TargetSize &size = pass_sizes[i];
 			
-			if (!passes.empty())
+			if (!setup_target_size(size, pass.width, pass.height)) return false;
+			
+			const string &target = pass.target;
+			if (target.empty()) continue;
+			
+			map<string, PersistentTarget>::iterator it = persistent_targets.find(target);
+			if (it != persistent_targets.end())
 			{
-				result_texture_name = passes.back().target;
+				if (!size.empty()) it->second.sized_by_pass = true;
+				continue;
 			}
 			
-			if (result_texture_name == "")
-				result_texture_name = "DEFAULT";
+			if (transient_targets.find(target) != transient_targets.end()) continue;
+			
+			uniforms.addUniform(target, create_target_uniform(target));
 			
-			result_texture = &framebuffer_map[result_texture_name].getTextureReference();
+			Ref_<ImageUniform> uniform = uniforms.getUniform(target).cast<ImageUniform>();
+			if (!uniform)
+			{
+				ofLogError("ofxISF::Shader") << "pass target conflicts with an input: " << target;
+				return false;
+			}
+			transient_targets[target] = uniform;
+			
+			// allocated up front, the sampler signature needs the texture target
+			acquire_framebuffer(target, size.empty() ? render_size : update_target_size(size));
 		}
 		
-		if (!code_generator.generate(shader_directive)) return false;
+		update_texture_refs();
 		
-		shader.unload();
-		if (!shader.setupShaderFromSource(GL_VERTEX_SHADER, code_generator.getVertexShader()))
-		{
-			cout << code_generator.getVertexShader() << endl;
-			return false;
-		}
+		animated = !presistent_buffers.empty() || CodeGenerator::usesIdentifier(bundle.shader_directive, "TIME");
+		rendered = false;
 		
-		if (!shader.setupShaderFromSource(GL_FRAGMENT_SHADER, code_generator.getFragmentShader()))
+		// the pass layout may have changed
+		if (profiling_enabled)
 		{
-			cout << code_generator.getFragmentShader() << endl;
-			return false;
+			setup_timers();
+			resetGpuTime();
 		}
 		
-		if (!shader.linkProgram())
+		// uniforms were rebuilt, none of the old programs match anymore
+		program_variants.clear();
+		shader = Program::Ref();
+		
+		return select_program(true);
+	}
+	
+	ofTexture* get_target_texture(const string& name)
+	{
+		map<string, PersistentTarget>::iterator it = persistent_targets.find(name);
+		if (it != persistent_targets.end())
+			return &it->second.getFront().getTextureReference();
+		
+		ofFbo *fbo = find_framebuffer(name);
+		return fbo ? &fbo->getTextureReference() : NULL;
+	}
+	
+	// fbo reallocation replaces the textures. with a pool, targets that
+	// aren't acquired keep pointing to the last texture they used.
+	bool set_planar_image(const string& name, ImageUniform::Planes planes, ofTexture *y, ofTexture *c0, ofTexture *c1, ImageUniform::ColorMatrix matrix, bool full_range)
+	{
+		Ref_<ImageUniform> o = uniforms.getUniform(name).cast<ImageUniform>();
+		if (!o)
 		{
+			ofLogError("ofxISF::Shader") << "no image input: " << name;
 			return false;
 		}
 		
+		if (!streaming_images.empty()) streaming_images.erase(name);
+		
+		if (!o->setPlanes(planes, y, c0, c1, matrix, full_range)) return false;
+		
+		planar_images.insert(name);
 		return true;
 	}
 	
-	//
-	
-	bool parse(const string& header_directive)
+	void setup_timers()
 	{
-		jsonxx::Object o;
-		assert(o.parse(header_directive));
+		if (!frame_timer) frame_timer = GpuTimer::Ref(new GpuTimer);
 		
-		description = o.get<string>("DESCRIPTION", "");
-		credit = o.get<string>("CREDIT", "");
+		size_t n = max<size_t>(passes.size(), 1);
+		while (pass_timers.size() < n)
+			pass_timers.push_back(GpuTimer::Ref(new GpuTimer));
+		pass_timers.resize(n);
+	}
+	
+	void collect_timers()
+	{
+		frame_timer->collect();
+		for (int i = 0; i < pass_timers.size(); i++)
+			pass_timers[i]->collect();
+	}
+	
+	void update_texture_refs()
+	{
+		textures.clear();
 		
-		jsonxx::Array a;
+		ofFbo *default_fbo = find_framebuffer("DEFAULT");
+		if (default_fbo) textures.push_back(&default_fbo->getTextureReference());
 		
+		for (int i = 0; i < presistent_buffers.size(); i++)
 		{
-			categories.clear();
-			a = o.get<jsonxx::Array>("CATEGORIES", jsonxx::Array());
-			for (int i = 0; i < a.size(); i++)
-				if (a.has<string>(i))
-					categories.push_back(a.get<string>(i));
+			// not set up yet while reload_shader() runs
+			map<string, PersistentTarget>::iterator it = persistent_targets.find(presistent_buffers[i].name);
+			if (it == persistent_targets.end() || !it->second.uniform) continue;
+			
+			PersistentTarget &target = it->second;
+			target.texture_index = textures.size();
+			textures.push_back(&target.getFront().getTextureReference());
+			target.uniform->set(textures.back());
 		}
 		
+		map<string, Ref_<ImageUniform> >::iterator it = transient_targets.begin();
+		while (it != transient_targets.end())
 		{
-			default_image_input_name = "";
-			input_uniforms.clear();
-			
-			a = o.get<jsonxx::Array>("INPUTS", jsonxx::Array());
-			for (int i = 0; i < a.size(); i++)
+			ofFbo *fbo = find_framebuffer(it->first);
+			if (fbo)
 			{
-				jsonxx::Object o = a.get<jsonxx::Object>(i, jsonxx::Object());
-				string name = o.get<string>("NAME", "");
-				string type = o.get<string>("TYPE", "");
-				
-				Input input;
-				input.name = name;
-				input.type = type;
-				inputs.push_back(input);
-				
-				if (type == "image"
-					&& default_image_input_name == "")
-				{
-					default_image_input_name = name;
-				}
-				
-				Uniform::Ref uniform = setup_input_uniform(o);
-				if (uniform)
-				{
-					// uniform type changed
-					if (uniforms.hasUniform(name)
-						&& uniforms.getUniform(name)->getTypeID() != uniform->getTypeID())
-					{
-						uniforms.removeUniform(name);
-					}
-					
-					uniforms.addUniform(name, uniform);
-					input_uniforms.addUniform(name, uniform);
-				}
+				textures.push_back(&fbo->getTextureReference());
+				it->second->set(textures.back());
 			}
+			it++;
+		}
+		
+		ofTexture *tex = get_target_texture(result_texture_name);
+		if (tex) result_texture = tex;
+	}
+	
+	ofFbo* find_framebuffer(const string& name)
+	{
+		if (!pool) return &framebuffer_map[name];
+		
+		map<string, ofFbo*>::iterator it = pooled_targets.find(name);
+		return it != pooled_targets.end() ? it->second : NULL;
+	}
+	
+	// (re)allocates an owned target, or acquires one from the pool for
+	// the rest of the frame
+	ofFbo& acquire_framebuffer(const string& name, const ofVec2f& size)
+	{
+		if (!pool)
+		{
+			ofFbo &fbo = framebuffer_map[name];
+			if (allocate_target(fbo, size, internalformat)) update_texture_refs();
+			return fbo;
+		}
+		
+		ofFbo *&fbo = pooled_targets[name];
+		if (fbo && (fbo->getWidth() != size.x || fbo->getHeight() != size.y))
+		{
+			pool->release(fbo);
+			fbo = NULL;
 		}
 		
+		if (!fbo)
 		{
-			presistent_buffers.clear();
+			fbo = pool->acquire(size.x, size.y, internalformat);
 			
-			if (o.has<jsonxx::Array>("PERSISTENT_BUFFERS"))
+			fbo->begin();
+			ofClear(0);
+			fbo->end();
+			
+			update_texture_refs();
+		}
+		
+		return *fbo;
+	}
+	
+	void release_framebuffers(bool keep_result)
+	{
+		if (!pool) return;
+		
+		map<string, ofFbo*>::iterator it = pooled_targets.begin();
+		while (it != pooled_targets.end())
+		{
+			if (keep_result && it->first == result_texture_name)
 			{
-				a = o.get<jsonxx::Array>("PERSISTENT_BUFFERS", jsonxx::Array());
-				for (int i = 0; i < a.size(); i++)
-				{
-					string name = a.get<string>(i);
-					
-					PresistentBuffer buf;
-					buf.name = name;
-					buf.width = render_size.x;
-					buf.height = render_size.y;
-					presistent_buffers.push_back(buf);
-				}
+				it++;
+				continue;
 			}
-			else if (o.has<jsonxx::Object>("PERSISTENT_BUFFERS"))
+			
+			pool->release(it->second);
+			pooled_targets.erase(it++);
+		}
+	}
+	
+	static bool allocate_target(ofFbo& fbo, const ofVec2f& size, int internalformat)
+	{
+		if (fbo.isAllocated()
+			&& fbo.getWidth() == size.x
+			&& fbo.getHeight() == size.y
+			&& fbo.getTextureReference().getTextureData().glTypeInternal == internalformat) return false;
+		
+		OFX_ISF_TRACE_SCOPE("Shader::allocate_target");
+		fbo.allocate(size.x, size.y, internalformat);
+		
+		fbo.begin();
+		ofClear(0);
+		fbo.end();
+		
+		return true;
+	}
+	
+	void resize_persistent_target(PersistentTarget& target, const ofVec2f& size)
+	{
+		bool reallocated = false;
+		for (int i = 0; i < 2; i++)
+			reallocated |= allocate_target(target.fbo[i], size, target.internalformat);
+		
+		if (reallocated) update_texture_refs();
+	}
+	
+	bool setup_target_size(TargetSize& size, const string& width, const string& height)
+	{
+		size = TargetSize();
+		
+		if (!width.empty() && !size.width.compile(width, size.variables)) return false;
+		if (!height.empty() && !size.height.compile(height, size.variables)) return false;
+		
+		for (int i = 0; i < size.variables.size(); i++)
+		{
+			const string &name = size.variables[i];
+			
+			Uniform::Ref source;
+			if (name != "WIDTH" && name != "HEIGHT")
 			{
-#if 0
-				jsonxx::Object obj = o.get<jsonxx::Object>("PERSISTENT_BUFFERS", jsonxx::Object());
-				const jsonxx::Object::container& kv_map = obj.kv_map();
-				
-				jsonxx::Object::container::const_iterator it = kv_map.begin();
-				while (it != kv_map.end())
+				source = uniforms.getUniform(name);
+				if (!source || !(source->isTypeOf<float>() || source->isTypeOf<bool>()))
 				{
-					string name = it->first;
-					PresistentBuffer buf;
-					buf.name = name;
-					
-					// TODO: uniform expression
-					buf.width = ...;
-					buf.height = ...;
-					
-					presistent_buffers.push_back(buf);
-					
-					it++;
+					ofLogError("ofxISF::Shader") << "size expression: unknown input $" << name;
+					return false;
 				}
-#endif
-				
-				throw "not implemented yet";
 			}
+			
+			size.sources.push_back(source);
 		}
 		
+		size.generations.resize(size.variables.size());
+		size.values.resize(size.variables.size());
+		
+		return true;
+	}
+	
+	const ofVec2f& update_target_size(TargetSize& size)
+	{
+		bool dirty = !size.evaluated || size.render_size != render_size;
+		
+		for (int i = 0; !dirty && i < size.sources.size(); i++)
 		{
-			passes.clear();
+			const Uniform::Ref &o = size.sources[i];
+			if (o && o->getGeneration() != size.generations[i]) dirty = true;
+		}
+		
+		if (!dirty) return size.size;
+		
+		for (int i = 0; i < size.variables.size(); i++)
+		{
+			const Uniform::Ref &o = size.sources[i];
 			
-			a = o.get<jsonxx::Array>("PASSES", jsonxx::Array());
-			for (int i = 0; i < a.size(); i++)
+			if (!o)
 			{
-				jsonxx::Object pass = a.get<jsonxx::Object>(i);
-				
-				string target = pass.get<string>("TARGET", "");
-				
-				// TODO: uniform expression
-				string width = pass.get<string>("WIDTH", "");
-				string height = pass.get<string>("HEIGHT", "");
-				
-				Pass o;
-				o.target = target;
-				
-				passes.push_back(o);
+				size.values[i] = size.variables[i] == "WIDTH" ? render_size.x : render_size.y;
+				continue;
 			}
+			
+			size.generations[i] = o->getGeneration();
+			
+			if (o->isTypeOf<float>())
+				size.values[i] = static_cast<Uniform_<float>*>(o.get())->value;
+			else
+				size.values[i] = static_cast<Uniform_<bool>*>(o.get())->value ? 1 : 0;
 		}
 		
-		return true;
+		const float *values = size.values.empty() ? NULL : &size.values[0];
+		
+		float w = size.width.empty() ? render_size.x : size.width.evaluate(values);
+		float h = size.height.empty() ? render_size.y : size.height.evaluate(values);
+		
+		size.size.set(max(1.0f, floorf(w)), max(1.0f, floorf(h)));
+		size.render_size = render_size;
+		size.evaluated = true;
+		
+		return size.size;
 	}
 	
-	Uniform::Ref setup_input_uniform(const jsonxx::Object& obj)
+	void swap_persistent_target(PersistentTarget& target)
 	{
-		string name = obj.get<string>("NAME", "");
-		string type = obj.get<string>("TYPE", "");
+		target.front ^= 1;
 		
-		Uniform::Ref uniform = NULL;
+		ofTexture *tex = &target.getFront().getTextureReference();
+		target.uniform->set(tex);
+		textures[target.texture_index] = tex;
 		
-		if (type == "image")
+		if (result_texture == &target.getBack().getTextureReference())
+			result_texture = tex;
+	}
+	
+	// compared one by one, rebinding a uniform restarts its generation
+	bool inputs_changed() const
+	{
+		if (rendered_inputs.size() != uniforms.size()) return true;
+		
+		for (int i = 0; i < uniforms.size(); i++)
 		{
-			uniform = new ImageUniform(name);
+			const Uniform *o = uniforms.getUniform(i).get();
+			if (rendered_inputs[i].first != o || rendered_inputs[i].second != o->getGeneration()) return true;
 		}
-		else if (type == "bool")
+		return false;
+	}
+	
+	void latch_inputs()
+	{
+		rendered_inputs.resize(uniforms.size());
+		for (int i = 0; i < uniforms.size(); i++)
 		{
-			uniform = new BoolUniform(name, obj.get<bool>("DEFAULT", false));
+			const Uniform *o = uniforms.getUniform(i).get();
+			rendered_inputs[i] = make_pair(o, o->getGeneration());
 		}
-		else if (type == "float")
+	}
+	
+	// the cached output is still acquired, persistent results are owned
+	bool has_result() const
+	{
+		if (!pool || persistent_targets.find(result_texture_name) != persistent_targets.end()) return true;
+		return pooled_targets.find(result_texture_name) != pooled_targets.end();
+	}
+	
+	string get_program_signature() const
+	{
+		return get_program_signature(uniforms, core_profile_enabled);
+	}
+	
+	// keys the program variants and the code stored in the bundle
+	static string get_program_signature(const Uniforms& uniforms, bool core_profile)
+	{
+		string signature = uniforms.getSamplerSignature();
+		if (uniforms.isBlockEnabled()) signature += ":block";
+		if (core_profile) signature += ":core";
+		return signature;
+	}
+	
+	static bool get_default_core_profile() { return ofIsGLProgrammableRenderer(); }
+	
+	// bound to an fbo texture, which follows ofGetUsingArbTex()
+	static Uniform::Ref create_target_uniform(const string& name)
+	{
+		return Uniform::Ref(new ImageUniform(name, ofGetUsingArbTex()));
+	}
+	
+	// true if any event was set
+	bool reset_block_events()
+	{
+		bool any = false;
+		
+		const vector<Ref_<EventUniform> >& events = uniforms.getEventUniforms();
+		for (int i = 0; i < events.size(); i++)
 		{
-			FloatUniform *o = new FloatUniform(name, obj.get<jsonxx::Number>("DEFAULT", 0));
-			
-			if (obj.has<jsonxx::Number>("MIN") && obj.has<jsonxx::Number>("MAX"))
-			{
-				float m0 = obj.get<jsonxx::Number>("MIN", std::numeric_limits<float>::min());
-				float m1 = obj.get<jsonxx::Number>("MAX", std::numeric_limits<float>::max());
-				o->setRange(m0, m1);
-			}
-			
-			uniform = o;
+			if (!events[i]->value) continue;
+			events[i]->set(false);
+			any = true;
 		}
-		else if (type == "color")
+		
+		return any;
+	}
+	
+	void upload_uniform_block()
+	{
+		const vector<unsigned char> &block = uniforms.getBlock();
+		if (block.empty()) return;
+		
+		if (uniform_buffer == 0) glGenBuffers(1, &uniform_buffer);
+		
+		if (uniform_buffer_size != block.size())
 		{
-			ofFloatColor def;
+			glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);
+			glBufferData(GL_UNIFORM_BUFFER, block.size(), &block[0], GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			uniform_buffer_size = block.size();
 			
-			jsonxx::Array a = obj.get<jsonxx::Array>("DEFAULT", jsonxx::Array());
-			if (a.size() == 4)
+			uniforms.clearBlockDirty();
+			upload_stats.uploaded++;
+			return;
+		}
+		
+		if (!uniforms.isBlockDirty())
+		{
+			upload_stats.skipped++;
+			return;
+		}
+		
+		glBindBuffer(GL_UNIFORM_BUFFER, uniform_buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, block.size(), &block[0]);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		
+		uniforms.clearBlockDirty();
+		upload_stats.uploaded++;
+	}
+	
+	bool select_program(bool store_in_bundle = false)
+	{
+		OFX_ISF_TRACE_SCOPE("Shader::select_program");
+		
+		string signature = get_program_signature();
+		
+		map<string, Program::Ref>::iterator it = program_variants.find(signature);
+		if (it != program_variants.end())
+		{
+			shader = it->second;
+			return true;
+		}
+		
+		if (!generate_code(signature, store_in_bundle)) return false;
+		
+		const string &vert = code_generator.getVertexShader();
+		const string &frag = code_generator.getFragmentShader();
+		
+		Program::Ref program = uniform_block_enabled ? Program::getShared(vert, frag) : Program::Ref(new Program);
+		
+		if (!program->isLoaded())
+		{
+			if (!program->load(vert, frag))
 			{
-				def.r = a.get<jsonxx::Number>(0, 0);
-				def.g = a.get<jsonxx::Number>(1, 0);
-				def.b = a.get<jsonxx::Number>(2, 0);
-				def.a = a.get<jsonxx::Number>(3, 0);
+				return false;
 			}
 			
-			uniform = new ColorUniform(name, def);
+			vector<UniformLocation> &locations = program->getUniformLocations();
+			locations.resize(uniforms.size());
+			for (int i = 0; i < uniforms.size(); i++)
+				uniforms.getUniform(i)->resolve(program->getProgram(), locations[i]);
+		}
+		
+		program_variants[signature] = program;
+		shader = program;
+		
+		return true;
+	}
+	
+	//
+	
+	bool generate_code(const string& signature, bool store_in_bundle)
+	{
+		OFX_ISF_TRACE_SCOPE("Shader::generate_code");
+		
+		if (!bundle.vert.empty()
+			&& bundle.sampler_signature == signature)
+		{
+			code_generator.setShader(bundle.vert, bundle.frag);
+			return true;
 		}
-		else if (type == "event")
+		
+		if (!code_generator.generate(bundle.shader_directive)) return false;
+		
+		// the bundle keeps the load time variant only
+		if (store_in_bundle)
 		{
-			uniform = new EventUniform(name);
+			bundle.sampler_signature = signature;
+			bundle.vert = code_generator.getVertexShader();
+			bundle.frag = code_generator.getFragmentShader();
+			BundleCache::store(bundle);
 		}
-		else if (type == "point2D")
+		
+		return true;
+	}
+	
+	void remove_unused_uniforms()
+	{
+		set<string> names;
+		
+		for (int i = 0; i < inputs.size(); i++)
+			names.insert(inputs[i].name);
+		
+		for (int i = 0; i < presistent_buffers.size(); i++)
+			names.insert(presistent_buffers[i].name);
+		
+		for (int i = 0; i < passes.size(); i++)
+			if (!passes[i].target.empty()) names.insert(passes[i].target);
+		
+		vector<string> unused;
+		for (int i = 0; i < uniforms.size(); i++)
 		{
-			ofVec2f def;
+			const string& name = uniforms.getUniform(i)->getName();
+			if (names.find(name) == names.end())
+				unused.push_back(name);
+		}
+		
+		for (int i = 0; i < unused.size(); i++)
+			uniforms.removeUniform(unused[i]);
+	}
+	
+	void setup_uniforms()
+	{
+		default_image_input_name = "";
+		input_uniforms.clear();
+		
+		for (int i = 0; i < inputs.size(); i++)
+		{
+			const Input &input = inputs[i];
+			const string &name = input.name;
 			
-			jsonxx::Array a = obj.get<jsonxx::Array>("DEFAULT", jsonxx::Array());
-			if (a.size() == 2)
+			if (input.type == "image"
+				&& default_image_input_name == "")
 			{
-				def.x = a.get<jsonxx::Number>(0, 0);
-				def.y = a.get<jsonxx::Number>(1, 0);
+				default_image_input_name = name;
 			}
 			
-			uniform = new Point2DUniform(name, def);
+			Uniform::Ref uniform = Uniforms::createUniform(input);
+			if (uniform)
+			{
+				// uniform type changed
+				if (uniforms.hasUniform(name)
+					&& uniforms.getUniform(name)->getTypeID() != uniform->getTypeID())
+				{
+					uniforms.removeUniform(name);
+				}
+				
+				// keeps the current value when the uniform already exists
+				uniforms.addUniform(name, uniform);
+				input_uniforms.addUniform(name, uniforms.getUniform(name));
+			}
 		}
-		
-		return uniform;
 	}
 };
 
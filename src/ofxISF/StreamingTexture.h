@@ -0,0 +1,371 @@
+#pragma once
+
+#include "Constants.h"
+#include "Trace.h"
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Texture fed from another thread, e.g. a video decoder, through a ring of
+// pixel buffer objects.
+//
+// The writer thread fills a mapped buffer between beginWrite() and
+// endWrite(), the GL thread only unmaps it and issues glTexSubImage2D
+// from the buffer in update(), so the copy overlaps with rendering. With
+// GL 4.4 / ARB_buffer_storage and sync objects the buffers stay mapped for
+// good and a fence guards their reuse, otherwise they are mapped again
+// right after the upload (the driver orphans the old storage). Needs GL 3.0
+// or ARB_pixel_buffer_object + ARB_map_buffer_range.
+//
+// Slots move FREE -> WRITING -> READY -> (IN_FLIGHT ->) FREE, ownership
+// changes by compare and swap. update() uploads the newest ready frame,
+// older ones are dropped. One writer thread at a time.
+//
+// Bind it with Shader::setImage(name, StreamingTexture&), the Shader then
+// calls update() and touches the input when a new frame arrived.
+
+class StreamingTexture
+{
+public:
+
+	enum {
+		NUM_SLOTS = 3
+	};
+
+	StreamingTexture()
+		:width(0)
+		,height(0)
+		,format(GL_RGBA)
+		,size(0)
+		,persistent(false)
+		,writing(-1)
+		,sequence(0)
+		,generation(0)
+		,num_dropped(0)
+	{}
+
+	~StreamingTexture() { release(); }
+
+	static bool isSupported()
+	{
+		return GLEW_VERSION_3_0 || (GLEW_ARB_pixel_buffer_object && GLEW_ARB_map_buffer_range);
+	}
+
+	// GL thread, before the writer starts. glFormat is the layout of the
+	// written pixels: GL_RGBA, GL_BGRA, GL_RGB, GL_BGR or GL_LUMINANCE
+	// (GL_RED), 8 bit each. single channel textures are GL_R8 with the
+	// programmable renderer.
+	bool setup(int width, int height, int glFormat = GL_RGBA)
+	{
+		release();
+
+		if (!isSupported())
+		{
+			ofLogError("ofxISF::StreamingTexture") << "pixel buffer objects or glMapBufferRange not supported";
+			return false;
+		}
+
+		int channels = get_num_channels(glFormat);
+		if (channels == 0)
+		{
+			ofLogError("ofxISF::StreamingTexture") << "unsupported format: 0x" << hex << glFormat;
+			return false;
+		}
+
+		bool core = ofIsGLProgrammableRenderer();
+
+		this->width = width;
+		this->height = height;
+		this->format = channels == 1 ? (core ? GL_RED : GL_LUMINANCE) : glFormat;
+
+		size = width * height * channels;
+
+		if (channels == 1 && core)
+		{
+			// GL_LUMINANCE is gone in core, the swizzle keeps sampling it as gray
+			texture.allocate(width, height, GL_R8);
+			if (GLEW_VERSION_3_3 || GLEW_ARB_texture_swizzle)
+			{
+				const GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+				const ofTextureData &data = texture.getTextureData();
+				glBindTexture(data.textureTarget, data.textureID);
+				glTexParameteriv(data.textureTarget, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+				glBindTexture(data.textureTarget, 0);
+			}
+		}
+		else
+		{
+			texture.allocate(width, height, channels == 1 ? GL_LUMINANCE : (channels == 3 ? GL_RGB : GL_RGBA));
+		}
+
+		persistent = (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) && (GLEW_VERSION_3_2 || GLEW_ARB_sync);
+
+		for (int i = 0; i < NUM_SLOTS; i++)
+		{
+			Slot &s = slots[i];
+
+			glGenBuffers(1, &s.buffer);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+
+			if (persistent)
+			{
+				const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+				s.ptr = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+			}
+			else
+			{
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+				s.ptr = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			}
+
+			if (s.ptr == NULL)
+			{
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				ofLogError("ofxISF::StreamingTexture") << "map failed";
+				release();
+				return false;
+			}
+
+			store_release(s.state, (int)FREE);
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return true;
+	}
+
+	// GL thread, after the writer stopped
+	void release()
+	{
+		for (int i = 0; i < NUM_SLOTS; i++)
+		{
+			Slot &s = slots[i];
+			if (s.buffer == 0) continue;
+
+			if (s.fence) glDeleteSync(s.fence);
+
+			if (s.ptr)
+			{
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			}
+
+			glDeleteBuffers(1, &s.buffer);
+
+			s.buffer = 0;
+			s.ptr = NULL;
+			s.fence = 0;
+			s.state = UNALLOCATED;
+		}
+
+		size = 0;
+		writing = -1;
+	}
+
+	// writer thread. width * height pixels of the setup() format, tightly
+	// packed. NULL while every slot is busy, drop the frame or retry.
+	unsigned char* beginWrite()
+	{
+		if (writing >= 0) return slots[writing].ptr;
+
+		for (int i = 0; i < NUM_SLOTS; i++)
+		{
+			Slot &s = slots[i];
+			if (OFX_ISF_CAS_INT(&s.state, (int)FREE, (int)WRITING))
+			{
+				writing = i;
+				return s.ptr;
+			}
+		}
+
+		return NULL;
+	}
+
+	void endWrite()
+	{
+		if (writing < 0) return;
+
+		Slot &s = slots[writing];
+		s.sequence = ++sequence;
+		store_release(s.state, (int)READY);
+
+		writing = -1;
+	}
+
+	// writer thread, copies a whole frame. false if it was dropped.
+	bool write(const unsigned char *pixels)
+	{
+		unsigned char *ptr = beginWrite();
+		if (ptr == NULL) return false;
+
+		memcpy(ptr, pixels, size);
+		endWrite();
+		return true;
+	}
+
+	// GL thread, uploads the newest ready frame. true if there was one.
+	bool update()
+	{
+		OFX_ISF_TRACE_SCOPE("StreamingTexture::update");
+
+		if (size == 0) return false;
+
+		// uploads the GPU is done with
+		for (int i = 0; i < NUM_SLOTS; i++)
+		{
+			Slot &s = slots[i];
+			if (load_acquire(s.state) != IN_FLIGHT) continue;
+
+			GLenum status = glClientWaitSync(s.fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+
+			glDeleteSync(s.fence);
+			s.fence = 0;
+			store_release(s.state, (int)FREE);
+		}
+
+		int newest = -1;
+		for (int i = 0; i < NUM_SLOTS; i++)
+		{
+			Slot &s = slots[i];
+			if (load_acquire(s.state) != READY) continue;
+
+			if (newest < 0 || s.sequence > slots[newest].sequence)
+			{
+				if (newest >= 0) drop(slots[newest]);
+				newest = i;
+			}
+			else
+			{
+				drop(s);
+			}
+		}
+
+		if (newest < 0) return false;
+
+		upload(slots[newest]);
+		generation++;
+
+		return true;
+	}
+
+	ofTexture& getTextureReference() { return texture; }
+
+	// bumped by every upload
+	unsigned int getGeneration() const { return generation; }
+
+	// frames replaced by a newer one before they were uploaded
+	unsigned long long getNumDropped() const { return num_dropped; }
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	bool isPersistentlyMapped() const { return persistent; }
+
+protected:
+
+	enum State
+	{
+		UNALLOCATED,
+		FREE,
+		WRITING,
+		READY,
+		IN_FLIGHT
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		unsigned char *ptr;
+		GLsync fence;
+		unsigned int sequence;
+		volatile int state;
+
+		Slot() : buffer(0), ptr(NULL), fence(0), sequence(0), state(UNALLOCATED) {}
+	};
+
+	Slot slots[NUM_SLOTS];
+
+	ofTexture texture;
+	int width, height;
+	int format;
+	size_t size;
+	bool persistent;
+
+	// writer thread
+	int writing;
+	unsigned int sequence;
+
+	// GL thread
+	unsigned int generation;
+	unsigned long long num_dropped;
+
+	void drop(Slot& s)
+	{
+		store_release(s.state, (int)FREE);
+		num_dropped++;
+	}
+
+	void upload(Slot& s)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+		if (!persistent) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		GLint previous_alignment = 4;
+		glGetIntegerv(GL_UNPACK_ALIGNMENT, &previous_alignment);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		const ofTextureData &data = texture.getTextureData();
+		glBindTexture(data.textureTarget, data.textureID);
+		glTexSubImage2D(data.textureTarget, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, 0);
+		glBindTexture(data.textureTarget, 0);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, previous_alignment);
+
+		if (persistent)
+		{
+			// the writer may only touch it again once the copy is done
+			s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			store_release(s.state, (int)IN_FLIGHT);
+
+			// update() polls without flushing
+			glFlush();
+		}
+		else
+		{
+			// fresh storage, the pending copy keeps reading the old one
+			s.ptr = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			if (s.ptr)
+			{
+				store_release(s.state, (int)FREE);
+			}
+			else
+			{
+				ofLogError("ofxISF::StreamingTexture") << "map failed";
+				store_release(s.state, (int)UNALLOCATED);
+			}
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	static int get_num_channels(int format)
+	{
+		switch (format)
+		{
+			case GL_RGBA:
+			case GL_BGRA: return 4;
+			case GL_RGB:
+			case GL_BGR: return 3;
+			case GL_LUMINANCE:
+			case GL_RED: return 1;
+			default: return 0;
+		}
+	}
+
+private:
+
+	StreamingTexture(const StreamingTexture&);
+	StreamingTexture& operator=(const StreamingTexture&);
+};
+
+OFX_ISF_END_NAMESPACE
@@ -0,0 +1,225 @@
+#pragma once
+
+#include "Constants.h"
+
+// OFX_ISF_TRACE_SCOPE("name") records the wall time of the enclosing
+// scope while Trace is enabled, name must be a string literal. Disabled
+// it costs a flag check, with OFX_ISF_DISABLE_TRACE defined nothing.
+
+#ifndef OFX_ISF_DISABLE_TRACE
+#define OFX_ISF_TRACE_CONCAT_(a, b) a##b
+#define OFX_ISF_TRACE_CONCAT(a, b) OFX_ISF_TRACE_CONCAT_(a, b)
+#define OFX_ISF_TRACE_SCOPE(name) ofx::ISF::TraceScope OFX_ISF_TRACE_CONCAT(ofx_isf_trace_scope_, __LINE__)(name)
+#else
+#define OFX_ISF_TRACE_SCOPE(name)
+#endif
+
+OFX_ISF_BEGIN_NAMESPACE
+
+// Every thread records into its own ring of events, only the owning thread
+// writes it. The rings are registered once in a lock-free list and never
+// freed, events of finished threads (e.g. Library workers) stay exportable.
+// When a ring is full the oldest events are overwritten.
+
+class Trace
+{
+public:
+
+	static void setEnabled(bool v) { store_release(getEnabledRef(), v); }
+	static bool isEnabled() { return getEnabledRef(); }
+
+	// events kept per thread, rounded up to a power of two. applies to
+	// threads that record their first event afterwards.
+	static void setBufferCapacity(size_t v) { getCapacityRef() = v; }
+
+	// shown in the trace viewer, call once from the thread itself. allocates
+	// the thread's ring like the first recorded event does.
+	static void setThreadName(const string& name) { get_thread_buffer()->name = name; }
+
+	static unsigned long long now() { return ofGetElapsedTimeMicros(); }
+
+	static void record(const char *name, unsigned long long begin, unsigned long long end)
+	{
+		ThreadBuffer *b = get_thread_buffer();
+
+		unsigned int n = b->count;
+		Event &e = b->events[n & b->mask];
+		e.name = name;
+		e.begin = begin;
+		e.end = end;
+
+		store_release(b->count, n + 1);
+	}
+
+	// Chrome trace event format, opens in chrome://tracing and Perfetto.
+	// disable tracing first for a consistent snapshot, threads recording
+	// meanwhile may overwrite the oldest events while they are written.
+	static void writeJSON(ostream& os)
+	{
+		os << "{\"traceEvents\":[";
+
+		bool first = true;
+
+		ThreadBuffer *b = load_acquire(getHeadRef());
+		while (b)
+		{
+			if (!b->name.empty())
+			{
+				if (!first) os << ",";
+				first = false;
+
+				os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->id
+					<< ",\"args\":{\"name\":\"" << escape(b->name) << "\"}}";
+			}
+
+			unsigned int n = load_acquire(b->count);
+			unsigned int num = min<unsigned int>(n, b->mask + 1);
+
+			for (unsigned int i = n - num; i != n; i++)
+			{
+				const Event &e = b->events[i & b->mask];
+
+				if (!first) os << ",";
+				first = false;
+
+				os << "{\"name\":\"" << escape(e.name) << "\",\"cat\":\"ofxISF\",\"ph\":\"X\""
+					<< ",\"ts\":" << e.begin
+					<< ",\"dur\":" << (e.end > e.begin ? e.end - e.begin : 0)
+					<< ",\"pid\":1,\"tid\":" << b->id << "}";
+			}
+
+			b = b->next;
+		}
+
+		os << "]}";
+	}
+
+	static bool save(const string& path)
+	{
+		ofstream os(ofToDataPath(path).c_str(), ios::trunc);
+		if (!os)
+		{
+			ofLogError("ofxISF::Trace") << "can't write " << path;
+			return false;
+		}
+
+		writeJSON(os);
+		return os.good();
+	}
+
+	// only while no thread is recording
+	static void clear()
+	{
+		ThreadBuffer *b = load_acquire(getHeadRef());
+		while (b)
+		{
+			store_release(b->count, 0u);
+			b = b->next;
+		}
+	}
+
+protected:
+
+	struct Event
+	{
+		const char *name;
+		unsigned long long begin, end;
+	};
+
+	struct ThreadBuffer
+	{
+		vector<Event> events;
+		unsigned int mask;
+		volatile unsigned int count;
+
+		int id;
+		string name;
+		ThreadBuffer *next;
+
+		ThreadBuffer(size_t capacity) : mask(1), count(0), id(0), next(NULL)
+		{
+			while (mask + 1 < capacity) mask = (mask << 1) | 1;
+			events.resize(mask + 1);
+		}
+	};
+
+	static volatile bool& getEnabledRef()
+	{
+		static volatile bool enabled = false;
+		return enabled;
+	}
+
+	static size_t& getCapacityRef()
+	{
+		static size_t capacity = 1 << 16;
+		return capacity;
+	}
+
+	static ThreadBuffer* volatile& getHeadRef()
+	{
+		static ThreadBuffer* volatile head = NULL;
+		return head;
+	}
+
+	static ThreadBuffer* get_thread_buffer()
+	{
+		static OFX_ISF_THREAD_LOCAL ThreadBuffer *local = NULL;
+		if (local) return local;
+
+		ThreadBuffer *b = new ThreadBuffer(getCapacityRef());
+
+		while (true)
+		{
+			ThreadBuffer *head = load_acquire(getHeadRef());
+			b->next = head;
+			b->id = head ? head->id + 1 : 0;
+
+			if (OFX_ISF_CAS_POINTER(&getHeadRef(), head, b)) break;
+		}
+
+		local = b;
+		return b;
+	}
+
+	static string escape(const string& s)
+	{
+		string o;
+		for (int i = 0; i < s.size(); i++)
+		{
+			const char c = s[i];
+			if (c == '"' || c == '\\') o += '\\';
+			if ((unsigned char)c >= 0x20) o += c;
+		}
+		return o;
+	}
+};
+
+class TraceScope
+{
+public:
+
+	TraceScope(const char *name) : name(NULL), begin(0)
+	{
+		if (!Trace::isEnabled()) return;
+
+		this->name = name;
+		begin = Trace::now();
+	}
+
+	~TraceScope()
+	{
+		if (name) Trace::record(name, begin, Trace::now());
+	}
+
+protected:
+
+	const char *name;
+	unsigned long long begin;
+
+private:
+
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+};
+
+OFX_ISF_END_NAMESPACE
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Constants.h"
+#include "Program.h"
 
 OFX_ISF_BEGIN_NAMESPACE
 
@@ -9,8 +10,13 @@ OFX_ISF_BEGIN_NAMESPACE
 class Shader;
 class CodeGenerator;
 class ImageUniform;
+class EventUniform;
 template <typename T>
 class Uniform_;
+template <typename T>
+class UniformHandle;
+class ParameterMailbox;
+class Automation;
 
 class Uniform
 {
@@ -18,27 +24,81 @@ public:
 
 	typedef Ref_<Uniform> Ref;
 
-	Uniform(const string& name, unsigned int type_id) : name(name), type_id(type_id)
+	Uniform(const string& name, unsigned int type_id) : name(name), type_id(type_id), generation(0), block_data(NULL), block_dirty(NULL)
 	{}
 	virtual ~Uniform() {}
 
 	const string& getName() const { return name; }
 
 	template <typename TT>
-	bool isTypeOf() const { return Type2Int<TT>::value() == type_id; }
+	bool isTypeOf() const { return Type2Int<TT>::value == type_id; }
 	
 	unsigned int getTypeID() const { return type_id; }
+	
+	// bumped on every value change, programs skip uploads of unchanged values
+	unsigned int getGeneration() const { return generation; }
+	
+	void touch()
+	{
+		generation++;
+		
+		if (block_data)
+		{
+			writeBlock(block_data);
+			*block_dirty = true;
+		}
+	}
+	
+	// std140 layout inside the ISFInputs uniform block, zero alignment
+	// for uniforms that can't live in a block (samplers)
+	virtual int getBlockAlignment() const { return 0; }
+	virtual int getBlockSize() const { return 0; }
+	
+	bool isInBlock() const { return block_data != NULL; }
 
 protected:
 
 	friend class CodeGenerator;
 	friend class Shader;
+	friend class Uniforms;
 	
 	string name;
 	unsigned int type_id;
+	unsigned int generation;
+	
+	// set by the owning Uniforms when the uniform block is enabled
+	unsigned char *block_data;
+	bool *block_dirty;
+	
+	virtual string getBlockMember() const { return ""; }
+	virtual void writeBlock(unsigned char *dst) const {}
+	
+	virtual bool needsUpload(const UniformLocation& loc) const
+	{
+		return !loc.uploaded || loc.generation != generation;
+	}
+	
+	// returns false if the upload was skipped
+	bool upload(UniformLocation& loc)
+	{
+		if (!needsUpload(loc)) return false;
+		
+		// update() may change the value itself (events reset), keep the
+		// generation that was actually sent
+		unsigned int uploaded_generation = generation;
+		update(loc);
+		loc.generation = uploaded_generation;
+		loc.uploaded = true;
+		return true;
+	}
 
 	virtual string getUniform() const = 0;
-	virtual void update(ofShader *shader) = 0;
+	virtual void update(const UniformLocation& loc) = 0;
+	
+	virtual void resolve(GLuint program, UniformLocation& loc) const
+	{
+		loc.location = glGetUniformLocation(program, name.c_str());
+	}
 };
 
 //
@@ -52,7 +112,7 @@ public:
 		return uniforms.size();
 	}
 	
-	Uniform::Ref getUniform(size_t idx) const
+	const Uniform::Ref& getUniform(size_t idx) const
 	{
 		return uniforms.at(idx);
 	}
@@ -72,6 +132,14 @@ public:
 	{
 		return image_uniforms;
 	}
+	
+	const vector<Ref_<EventUniform> >& getEventUniforms() const
+	{
+		return event_uniforms;
+	}
+	
+	// one character per image uniform (two for planar YUV), identifies the lookup code the program was generated for
+	string getSamplerSignature() const;
 
 public:
 	
@@ -86,7 +154,7 @@ public:
 	
 	void removeUniform(const string& key)
 	{
-		if (hasUniform(key)) return false;
+		if (!hasUniform(key)) return;
 		
 		uniforms_map.erase(key);
 		updateCache();
@@ -94,21 +162,69 @@ public:
 	
 	template <typename T0, typename T1>
 	void setUniform(const string& name, const T1& value);
+	
+	// resolves the name once, writes through the handle skip the map lookup
+	template <typename T>
+	UniformHandle<T> getHandle(const string& name) const;
+	
+	// builds the uniform for an ISF input declaration, NULL for unknown types
+	static Uniform::Ref createUniform(const Input& input);
 
 	void clear()
 	{
-		uniforms.clear();
 		uniforms_map.clear();
-		image_uniforms.clear();
+		updateCache();
+	}
+	
+	//
+	
+	Uniforms() : block_enabled(false), block_dirty(false) {}
+	~Uniforms() { releaseBlock(); }
+	
+	// packs all non-sampler uniforms into one std140 block, set() writes
+	// straight into it. only one Uniforms may own the block of a uniform.
+	void setBlockEnabled(bool v)
+	{
+		if (block_enabled == v) return;
+		block_enabled = v;
+		updateCache();
 	}
+	
+	bool isBlockEnabled() const { return block_enabled; }
+	
+	const vector<unsigned char>& getBlock() const { return block; }
+	bool isBlockDirty() const { return block_dirty; }
+	void clearBlockDirty() { block_dirty = false; }
+	
+	string getBlockDeclaration() const;
+	
+	// curves driving uniforms of this set, created on first use. defined
+	// in Automation.h
+	Automation& getAutomation();
+	void updateAutomation(float time);
 
 protected:
 
 	vector<Uniform::Ref> uniforms;
 	mutable map<string, Uniform::Ref> uniforms_map;
 	vector<Ref_<ImageUniform> > image_uniforms;
+	vector<Ref_<EventUniform> > event_uniforms;
+	
+	bool block_enabled;
+	bool block_dirty;
+	vector<unsigned char> block;
+	vector<Uniform::Ref> block_members;
+	
+	Ref_<Automation> automation;
 	
 	void updateCache();
+	void updateBlock();
+	void releaseBlock();
+	
+private:
+	
+	Uniforms(const Uniforms&);
+	Uniforms& operator=(const Uniforms&);
 };
 
 //
@@ -120,23 +236,31 @@ public:
 
 	typedef T Type;
 
+	// write through set() or call touch() afterwards, otherwise the change
+	// is not uploaded
 	T value;
 	T min, max;
 	bool has_range;
 
-	Uniform_(const string& name, const T& default_value = T()) : Uniform(name, Type2Int<T>::value()), value(default_value), has_range(false) {}
+	Uniform_(const string& name, const T& default_value = T()) : Uniform(name, Type2Int<T>::value), value(default_value), has_range(false) {}
 
 	void setRange(const T& min_, const T& max_)
 	{
 		has_range = true;
 		min = min_;
 		max = max_;
+		touch();
 	}
 
 	template <typename TT>
 	void set(const TT& v)
 	{
-		value = v;
+		T new_value = v;
+		bool was_reset = reset_state();
+		if (new_value == value && !was_reset) return;
+		
+		value = new_value;
+		touch();
 	}
 
 	template <typename TT>
@@ -145,6 +269,12 @@ public:
 		TT v = value;
 		return v;
 	}
+
+protected:
+
+	// drops state a plain set() replaces along with the value, true if
+	// there was any
+	virtual bool reset_state() { return false; }
 };
 
 class BoolUniform : public Uniform_<bool>
@@ -153,13 +283,24 @@ public:
 
 	BoolUniform(const string& name, const bool& default_value = Type()) : Uniform_(name, default_value) {}
 
-	void update(ofShader *shader)
+	void update(const UniformLocation& loc)
 	{
-		shader->setUniform1i(name, value);
+		glUniform1i(loc.location, value);
 	}
+	
+	int getBlockAlignment() const { return 4; }
+	int getBlockSize() const { return 4; }
 
 protected:
 
+	string getBlockMember() const { return "bool " + getName() + ";"; }
+	
+	void writeBlock(unsigned char *dst) const
+	{
+		GLint v = value;
+		memcpy(dst, &v, sizeof(v));
+	}
+
 	string getUniform() const
 	{
 		string s = _S(
@@ -176,14 +317,25 @@ public:
 
 	FloatUniform(const string& name, const float& default_value = Type()) : Uniform_(name, default_value) {}
 
-	void update(ofShader *shader)
+	void update(const UniformLocation& loc)
 	{
 		if (has_range) value = ofClamp(value, min, max);
-		shader->setUniform1f(name, value);
+		glUniform1f(loc.location, value);
 	}
+	
+	int getBlockAlignment() const { return 4; }
+	int getBlockSize() const { return 4; }
 
 protected:
 
+	string getBlockMember() const { return "float " + getName() + ";"; }
+	
+	void writeBlock(unsigned char *dst) const
+	{
+		float v = has_range ? ofClamp(value, min, max) : value;
+		memcpy(dst, &v, sizeof(v));
+	}
+
 	string getUniform() const
 	{
 		string s = _S(
@@ -200,7 +352,7 @@ public:
 
 	ColorUniform(const string& name, const ofFloatColor& default_value = Type()) : Uniform_(name, default_value) {}
 
-	void update(ofShader *shader)
+	void update(const UniformLocation& loc)
 	{
 		if (has_range)
 		{
@@ -209,11 +361,29 @@ public:
 			value.b = ofClamp(value.b, min.b, max.b);
 			value.a = ofClamp(value.a, min.a, max.a);
 		}
-		shader->setUniform4fv(name, &value.r);
+		glUniform4fv(loc.location, 1, &value.r);
 	}
+	
+	int getBlockAlignment() const { return 16; }
+	int getBlockSize() const { return 16; }
 
 protected:
 
+	string getBlockMember() const { return "vec4 " + getName() + ";"; }
+	
+	void writeBlock(unsigned char *dst) const
+	{
+		ofFloatColor v = value;
+		if (has_range)
+		{
+			v.r = ofClamp(v.r, min.r, max.r);
+			v.g = ofClamp(v.g, min.g, max.g);
+			v.b = ofClamp(v.b, min.b, max.b);
+			v.a = ofClamp(v.a, min.a, max.a);
+		}
+		memcpy(dst, &v.r, sizeof(float) * 4);
+	}
+
 	string getUniform() const
 	{
 		string s = _S(
@@ -230,13 +400,23 @@ public:
 
 	Point2DUniform(const string& name, const ofVec2f& default_value = Type()) : Uniform_(name, default_value) {}
 
-	void update(ofShader *shader)
+	void update(const UniformLocation& loc)
 	{
-		shader->setUniform2fv(name, value.getPtr());
+		glUniform2fv(loc.location, 1, value.getPtr());
 	}
+	
+	int getBlockAlignment() const { return 8; }
+	int getBlockSize() const { return 8; }
 
 protected:
 
+	string getBlockMember() const { return "vec2 " + getName() + ";"; }
+	
+	void writeBlock(unsigned char *dst) const
+	{
+		memcpy(dst, value.getPtr(), sizeof(float) * 2);
+	}
+
 	string getUniform() const
 	{
 		string s = _S(
@@ -251,34 +431,113 @@ class ImageUniform : public Uniform_<ofTexture*>
 {
 public:
 
-	ImageUniform(const string& name) : Uniform_(name, NULL), is_rectangle_texture(false) {}
+	// planar YUV inputs are sampled and converted by the generated lookup
+	// code, the value is the luma plane
+	enum Planes
+	{
+		PLANES_RGB,
+		PLANES_NV12, // Y + interleaved UV (2 channels)
+		PLANES_I420 // Y + U + V
+	};
+	
+	enum ColorMatrix
+	{
+		YUV_BT601,
+		YUV_BT709
+	};
+
+	// unbound_rectangle: sampler type assumed while no texture is bound
+	ImageUniform(const string& name, bool unbound_rectangle = false)
+		:Uniform_(name, NULL)
+		,is_rectangle_texture(false)
+		,unbound_rectangle(unbound_rectangle)
+		,planes(PLANES_RGB)
+		,latched_planes(PLANES_RGB)
+		,latched_luminance_alpha(false)
+	{
+		chroma[0] = chroma[1] = NULL;
+		set_yuv_matrix(YUV_BT709, false);
+	}
 
-	void update(ofShader *shader)
+	void update(const UniformLocation& loc)
 	{
 		if (value == NULL) return;
-		int &texture_unit_id = getTextureUnitID();
-		shader->setUniformTexture(name, *value, ++texture_unit_id);
-
-		string s = "_$NAME$_pct";
-		ofStringReplace(s, "$NAME$", getName());
+		
+		bind(value, loc.location);
 		
 		ofVec2f pct = value->getCoordFromPercent(1, 1);
-		shader->setUniform2fv(s, pct.getPtr());
+		glUniform2fv(loc.extra_location, 1, pct.getPtr());
+		
+		if (planes == PLANES_RGB) return;
+		
+		int num_chroma = planes == PLANES_NV12 ? 1 : 2;
+		for (int i = 0; i < num_chroma; i++)
+			bind(chroma[i], loc.plane_location[i]);
+		
+		pct = chroma[0]->getCoordFromPercent(1, 1);
+		glUniform2fv(loc.plane_pct_location, 1, pct.getPtr());
+		glUniformMatrix4fv(loc.yuv_matrix_location, 1, GL_FALSE, yuv_matrix);
 	}
+	
+	// luma sets the size, chroma planes are usually half of it. all planes
+	// need the same texture target. full_range: 0-255 instead of 16-235.
+	bool setPlanes(Planes planes, ofTexture *y, ofTexture *c0, ofTexture *c1 = NULL, ColorMatrix matrix = YUV_BT709, bool full_range = false)
+	{
+		if (planes != PLANES_RGB)
+		{
+			int num_chroma = planes == PLANES_NV12 ? 1 : 2;
+			ofTexture *c[2] = { c0, c1 };
+			
+			for (int i = 0; i < num_chroma; i++)
+			{
+				if (y == NULL || c[i] == NULL
+					|| c[i]->getTextureData().textureTarget != y->getTextureData().textureTarget)
+				{
+					ofLogError("ofxISF::ImageUniform") << "missing or mismatching chroma plane: " << getName();
+					return false;
+				}
+			}
+		}
+		
+		this->planes = planes;
+		chroma[0] = planes == PLANES_RGB ? NULL : c0;
+		chroma[1] = planes == PLANES_I420 ? c1 : NULL;
+		set_yuv_matrix(matrix, full_range);
+		
+		value = y;
+		touch();
+		return true;
+	}
+	
+	Planes getPlanes() const { return value == NULL ? PLANES_RGB : planes; }
+	
+	// NV12 chroma in a GL_LUMINANCE_ALPHA texture, sampled as .ra instead of .rg
+	bool isChromaLuminanceAlpha() const
+	{
+		if (getPlanes() != PLANES_NV12) return false;
+		GLint format = chroma[0]->getTextureData().glTypeInternal;
+		return format == GL_LUMINANCE_ALPHA || format == GL_LUMINANCE8_ALPHA8;
+	}
+	
+	// texture units are shared between shaders, so the binding is redone every pass
+	bool needsUpload(const UniformLocation& loc) const { return value != NULL; }
 
 	bool isValid() const { return value != NULL; }
 
 	bool isRectangleTexture() const
 	{
-		if (value == NULL) return false;
+		if (value == NULL) return unbound_rectangle;
 		return value->texData.textureTarget == GL_TEXTURE_RECTANGLE_ARB;
 	}
 	
 	bool checkTextureFormatChanged()
 	{
 		if (value == NULL) return false;
-		bool result = is_rectangle_texture != isRectangleTexture();
+		bool result = is_rectangle_texture != isRectangleTexture() || latched_planes != planes
+			|| latched_luminance_alpha != isChromaLuminanceAlpha();
 		is_rectangle_texture = isRectangleTexture();
+		latched_planes = planes;
+		latched_luminance_alpha = isChromaLuminanceAlpha();
 		return result;
 	}
 
@@ -292,6 +551,41 @@ public:
 protected:
 
 	bool is_rectangle_texture;
+	bool unbound_rectangle;
+	
+	Planes planes, latched_planes;
+	bool latched_luminance_alpha;
+	ofTexture *chroma[2];
+	float yuv_matrix[16];
+	
+	// a texture bound through set() is plain RGB
+	bool reset_state()
+	{
+		if (planes == PLANES_RGB) return false;
+		
+		planes = PLANES_RGB;
+		chroma[0] = chroma[1] = NULL;
+		return true;
+	}
+	
+	void resolve(GLuint program, UniformLocation& loc) const
+	{
+		loc.location = glGetUniformLocation(program, name.c_str());
+		loc.extra_location = glGetUniformLocation(program, ("_" + name + "_pct").c_str());
+		
+		if (getPlanes() == PLANES_NV12)
+		{
+			loc.plane_location[0] = glGetUniformLocation(program, ("_" + name + "_uv").c_str());
+		}
+		else if (getPlanes() == PLANES_I420)
+		{
+			loc.plane_location[0] = glGetUniformLocation(program, ("_" + name + "_u").c_str());
+			loc.plane_location[1] = glGetUniformLocation(program, ("_" + name + "_v").c_str());
+		}
+		
+		loc.plane_pct_location = glGetUniformLocation(program, ("_" + name + "_uv_pct").c_str());
+		loc.yuv_matrix_location = glGetUniformLocation(program, ("_" + name + "_yuv").c_str());
+	}
 	
 	string getUniform() const
 	{
@@ -299,11 +593,80 @@ protected:
 			uniform $SAMPLER$ $NAME$;
 			uniform vec2 _$NAME$_pct;
 		);
+		
+		if (getPlanes() == PLANES_NV12)
+		{
+			s += _S(
+				uniform $SAMPLER$ _$NAME$_uv;
+			);
+		}
+		else if (getPlanes() == PLANES_I420)
+		{
+			s += _S(
+				uniform $SAMPLER$ _$NAME$_u;
+				uniform $SAMPLER$ _$NAME$_v;
+			);
+		}
+		
+		if (getPlanes() != PLANES_RGB)
+		{
+			s += _S(
+				uniform vec2 _$NAME$_uv_pct;
+				uniform mat4 _$NAME$_yuv;
+			);
+		}
+		
 		ofStringReplace(s, "$NAME$", getName());
 		ofStringReplace(s, "$SAMPLER$", isRectangleTexture() ? "sampler2DRect" : "sampler2D");
 		return s;
 	}
 	
+	void bind(ofTexture *tex, GLint location) const
+	{
+		int &texture_unit_id = getTextureUnitID();
+		++texture_unit_id;
+		
+		const ofTextureData &data = tex->getTextureData();
+		glActiveTexture(GL_TEXTURE0 + texture_unit_id);
+		glBindTexture(data.textureTarget, data.textureID);
+		glUniform1i(location, texture_unit_id);
+		glActiveTexture(GL_TEXTURE0);
+	}
+	
+	// rgb = m * vec4(y, u, v, 1), column major
+	void set_yuv_matrix(ColorMatrix matrix, bool full_range)
+	{
+		float kr = matrix == YUV_BT601 ? 0.299f : 0.2126f;
+		float kb = matrix == YUV_BT601 ? 0.114f : 0.0722f;
+		float kg = 1 - kr - kb;
+		
+		float ys = full_range ? 1 : 255.0f / 219.0f;
+		float cs = full_range ? 1 : 255.0f / 224.0f;
+		float yo = full_range ? 0 : 16.0f / 255.0f;
+		float co = 128.0f / 255.0f;
+		
+		float m[3][3] = {
+			{ 1, 0, 2 * (1 - kr) },
+			{ 1, -2 * kb * (1 - kb) / kg, -2 * kr * (1 - kr) / kg },
+			{ 1, 2 * (1 - kb), 0 }
+		};
+		
+		for (int r = 0; r < 3; r++)
+		{
+			float y = m[r][0] * ys;
+			float u = m[r][1] * cs;
+			float v = m[r][2] * cs;
+			
+			yuv_matrix[0 * 4 + r] = y;
+			yuv_matrix[1 * 4 + r] = u;
+			yuv_matrix[2 * 4 + r] = v;
+			yuv_matrix[3 * 4 + r] = -y * yo - (u + v) * co;
+		}
+		
+		yuv_matrix[3] = yuv_matrix[7] = yuv_matrix[11] = 0;
+		yuv_matrix[15] = 1;
+	}
+	
 	static int& getTextureUnitID()
 	{
 		static int id = 0;
@@ -317,14 +680,30 @@ public:
 
 	EventUniform(const string& name) : Uniform_(name, false) {}
 
-	void update(ofShader *shader)
+	void update(const UniformLocation& loc)
 	{
-		shader->setUniform1i(name, value);
-		value = false;
+		glUniform1i(loc.location, value);
+		
+		if (value)
+		{
+			value = false;
+			touch();
+		}
 	}
+	
+	int getBlockAlignment() const { return 4; }
+	int getBlockSize() const { return 4; }
 
 protected:
 
+	string getBlockMember() const { return "bool " + getName() + ";"; }
+	
+	void writeBlock(unsigned char *dst) const
+	{
+		GLint v = value;
+		memcpy(dst, &v, sizeof(v));
+	}
+
 	string getUniform() const
 	{
 		string s = _S(
@@ -337,6 +716,61 @@ protected:
 
 //
 
+// typed reference to a uniform, obtained once by name with Uniforms::getHandle.
+// the handle keeps the uniform alive, but after a reload that replaced the
+// uniform (type change, input removed) it writes to a detached one.
+template <typename T>
+class UniformHandle
+{
+public:
+	
+	typedef T Type;
+	
+	UniformHandle() : ptr(NULL) {}
+	
+	bool isValid() const { return ptr != NULL; }
+	const string& getName() const { return ptr->getName(); }
+	
+	template <typename TT>
+	void set(const TT& v) { ptr->set(v); }
+	
+	const T& get() const { return ptr->value; }
+	
+	Uniform_<T>* operator->() const { return ptr; }
+	
+protected:
+	
+	friend class Uniforms;
+	friend class ParameterMailbox;
+	friend class Automation;
+	
+	Uniform::Ref ref;
+	Uniform_<T> *ptr;
+};
+
+template <typename T>
+inline UniformHandle<T> Uniforms::getHandle(const string& name) const
+{
+	UniformHandle<T> handle;
+	
+	map<string, Uniform::Ref>::const_iterator it = uniforms_map.find(name);
+	if (it == uniforms_map.end())
+	{
+		ofLogError("ofxISF::Uniforms") << "uniform not found: " << name;
+		return handle;
+	}
+	
+	if (!it->second->isTypeOf<T>())
+	{
+		ofLogError("ofxISF::Uniforms") << "type mismatch: " << name;
+		return handle;
+	}
+	
+	handle.ref = it->second;
+	handle.ptr = static_cast<Uniform_<T>*>(it->second.get());
+	return handle;
+}
+
 template <typename INT_TYPE, typename EXT_TYPE>
 inline void Uniforms::setUniform(const string& name, const EXT_TYPE& value)
 {
@@ -354,15 +788,74 @@ inline void Uniforms::setUniform(const string& name, const EXT_TYPE& value)
 	}
 	
 	Uniform_<INT_TYPE> *ptr = (Uniform_<INT_TYPE>*)p.get();
-	ptr->value = value;
+	ptr->set(value);
 }
 
 //
 
+inline Uniform::Ref Uniforms::createUniform(const Input& input)
+{
+	const string &name = input.name;
+	const string &type = input.type;
+	const float *def = input.default_value;
+	
+	Uniform::Ref uniform = NULL;
+	
+	if (type == "image")
+	{
+		uniform = new ImageUniform(name);
+	}
+	else if (type == "bool")
+	{
+		uniform = new BoolUniform(name, def[0] != 0);
+	}
+	else if (type == "float")
+	{
+		FloatUniform *o = new FloatUniform(name, def[0]);
+		
+		if (input.has_range)
+		{
+			o->setRange(input.min_value[0], input.max_value[0]);
+		}
+		
+		uniform = o;
+	}
+	else if (type == "color")
+	{
+		uniform = new ColorUniform(name, ofFloatColor(def[0], def[1], def[2], def[3]));
+	}
+	else if (type == "event")
+	{
+		uniform = new EventUniform(name);
+	}
+	else if (type == "point2D")
+	{
+		uniform = new Point2DUniform(name, ofVec2f(def[0], def[1]));
+	}
+	
+	return uniform;
+}
+
+inline string Uniforms::getSamplerSignature() const
+{
+	string s;
+	for (int i = 0; i < image_uniforms.size(); i++)
+	{
+		const Ref_<ImageUniform> &o = image_uniforms[i];
+		s += o->isRectangleTexture() ? 'R' : '2';
+		
+		// planar inputs generate different lookup code
+		if (o->getPlanes() == ImageUniform::PLANES_NV12) s += o->isChromaLuminanceAlpha() ? 'l' : 'n';
+		else if (o->getPlanes() == ImageUniform::PLANES_I420) s += 'i';
+	}
+	return s;
+}
+
 inline void Uniforms::updateCache()
 {
 	uniforms.clear();
 	image_uniforms.clear();
+	event_uniforms.clear();
 	
 	map<string, Uniform::Ref>::iterator it = uniforms_map.begin();
 	while (it != uniforms_map.end())
@@ -374,8 +867,75 @@ inline void Uniforms::updateCache()
 			Ref_<ImageUniform> p = o.cast<ImageUniform>();
 			image_uniforms.push_back(p);
 		}
+		else if (o->isTypeOf<bool>())
+		{
+			Ref_<EventUniform> p = o.cast<EventUniform>();
+			if (p) event_uniforms.push_back(p);
+		}
 		it++;
 	}
+	
+	updateBlock();
+}
+
+inline void Uniforms::releaseBlock()
+{
+	for (int i = 0; i < block_members.size(); i++)
+	{
+		block_members[i]->block_data = NULL;
+		block_members[i]->block_dirty = NULL;
+	}
+	
+	block_members.clear();
+	block.clear();
+}
+
+inline void Uniforms::updateBlock()
+{
+	releaseBlock();
+	
+	if (!block_enabled) return;
+	
+	vector<size_t> offsets;
+	size_t offset = 0;
+	
+	for (int i = 0; i < uniforms.size(); i++)
+	{
+		const Uniform::Ref &o = uniforms[i];
+		
+		size_t align = o->getBlockAlignment();
+		if (align == 0) continue;
+		
+		offset = (offset + align - 1) / align * align;
+		offsets.push_back(offset);
+		block_members.push_back(o);
+		
+		offset += o->getBlockSize();
+	}
+	
+	// std140 rounds the block up to vec4
+	block.assign((offset + 15) / 16 * 16, 0);
+	
+	for (int i = 0; i < block_members.size(); i++)
+	{
+		Uniform *o = block_members[i].get();
+		o->block_data = &block[offsets[i]];
+		o->block_dirty = &block_dirty;
+		o->writeBlock(o->block_data);
+	}
+	
+	block_dirty = true;
+}
+
+inline string Uniforms::getBlockDeclaration() const
+{
+	if (block_members.empty()) return "";
+	
+	string s = "layout(std140) uniform ISFInputs\n{\n";
+	for (int i = 0; i < block_members.size(); i++)
+		s += "\t" + block_members[i]->getBlockMember() + "\n";
+	s += "};\n";
+	return s;
 }
 
 #undef _S